@@ -0,0 +1,159 @@
+// Conditional GET support for HttpClient, so unchanged resources aren't
+// downloaded again
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpCache.h"
+
+// Headers captured from each response, in the order capturedHeader() uses
+static const char* kValidatorHeaders[] = { HTTP_HEADER_ETAG, HTTP_HEADER_LAST_MODIFIED };
+
+// Hash the URL two ways: FNV-1a for the key its validators are stored
+// under, and Jenkins' one-at-a-time hash for aCheck, to tell apart URLs
+// whose keys collide
+static uint32_t hashURL(const char* aServerName, uint16_t aServerPort, const char* aURLPath, uint32_t& aCheck)
+{
+    uint32_t hash = 2166136261UL;
+    uint32_t check = 0;
+    const char* parts[] = { aServerName, aURLPath };
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        const char* p = parts[i];
+        while (p && *p)
+        {
+            hash ^= (uint8_t)*p;
+            hash *= 16777619UL;
+            check += (uint8_t)*p++;
+            check += check << 10;
+            check ^= check >> 6;
+        }
+        if (i == 0)
+        {
+            hash ^= aServerPort;
+            hash *= 16777619UL;
+            for (uint8_t j = 0; j < 2; j++)
+            {
+                check += (uint8_t)(aServerPort >> (j * 8));
+                check += check << 10;
+                check ^= check >> 6;
+            }
+        }
+    }
+    check += check << 3;
+    check ^= check >> 11;
+    check += check << 15;
+    aCheck = check;
+    // 0 marks an empty entry
+    return hash ? hash : 1;
+}
+
+// Copy a string, but only if it fits
+static void copyValidator(char* aDest, size_t aDestSize, const char* aSrc)
+{
+    if (aSrc && (strlen(aSrc) < aDestSize))
+    {
+        strcpy(aDest, aSrc);
+    }
+    else
+    {
+        aDest[0] = '\0';
+    }
+}
+
+HttpRamValidatorStore::HttpRamValidatorStore()
+{
+    memset(iEntries, 0, sizeof(iEntries));
+}
+
+bool HttpRamValidatorStore::load(uint32_t aKey, HttpValidators& aValidators)
+{
+    const HttpValidators& entry = iEntries[aKey % HTTP_CACHE_RAM_ENTRIES];
+    if (entry.iKey != aKey)
+    {
+        return false;
+    }
+    aValidators = entry;
+    return true;
+}
+
+void HttpRamValidatorStore::save(const HttpValidators& aValidators)
+{
+    iEntries[aValidators.iKey % HTTP_CACHE_RAM_ENTRIES] = aValidators;
+}
+
+HttpCache::HttpCache(HttpClient& aHttp, HttpValidatorStore& aStore)
+ : iHttp(&aHttp), iStore(&aStore), iCacheHit(false), iPending(false)
+{
+    memset(&iValidators, 0, sizeof(iValidators));
+}
+
+int HttpCache::get(const char* aServerName, uint16_t aServerPort, const char* aURLPath, const char* aUserAgent)
+{
+    iCacheHit = false;
+    iPending = false;
+
+    uint32_t check;
+    uint32_t key = hashURL(aServerName, aServerPort, aURLPath, check);
+    if (!iStore->load(key, iValidators) || (iValidators.iCheck != check))
+    {
+        // Nothing stored for this URL.  (An entry with the same key but a
+        // different check is for another URL, so mustn't be used)
+        memset(&iValidators, 0, sizeof(iValidators));
+    }
+    iValidators.iKey = key;
+    iValidators.iCheck = check;
+
+    // Send the request, with whichever validators we've got
+    iHttp->beginRequest();
+    int ret = iHttp->startRequest(aServerName, aServerPort, aURLPath, HTTP_METHOD_GET, aUserAgent);
+    if (ret != HTTP_SUCCESS)
+    {
+        return ret;
+    }
+    if (iValidators.iETag[0])
+    {
+        iHttp->sendHeader(HTTP_HEADER_IF_NONE_MATCH, iValidators.iETag);
+    }
+    if (iValidators.iLastModified[0])
+    {
+        iHttp->sendHeader(HTTP_HEADER_IF_MODIFIED_SINCE, iValidators.iLastModified);
+    }
+    iHttp->endRequest();
+
+    // And look out for new validators in the response
+    iHttp->captureHeaders(kValidatorHeaders, 2, iHeaderBuffer, sizeof(iHeaderBuffer));
+    ret = iHttp->responseStatusCode();
+    if (ret < 0)
+    {
+        return ret;
+    }
+    int err = iHttp->skipResponseHeaders();
+    if (err != HTTP_SUCCESS)
+    {
+        return err;
+    }
+
+    if (ret == 304)
+    {
+        // Our copy is still good
+        iCacheHit = true;
+    }
+    else if (ret == 200)
+    {
+        // Remember the new validators, ready for commit().  If there aren't
+        // any this clears out the old ones
+        copyValidator(iValidators.iETag, sizeof(iValidators.iETag), iHttp->capturedHeader(0));
+        copyValidator(iValidators.iLastModified, sizeof(iValidators.iLastModified), iHttp->capturedHeader(1));
+        iPending = true;
+    }
+    return ret;
+}
+
+void HttpCache::commit()
+{
+    if (iPending)
+    {
+        iStore->save(iValidators);
+        iPending = false;
+    }
+}
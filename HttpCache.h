@@ -0,0 +1,133 @@
+// Conditional GET support for HttpClient, so unchanged resources aren't
+// downloaded again
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpCache_h
+#define HttpCache_h
+
+#include "HttpClient.h"
+
+// Longest ETag (including its quotes and a terminating '\0') that will be
+// remembered.  Longer ones are dropped, so that resource is always fetched
+#ifndef HTTP_CACHE_ETAG_SIZE
+#ifdef __AVR__
+#define HTTP_CACHE_ETAG_SIZE 32
+#else
+#define HTTP_CACHE_ETAG_SIZE 64
+#endif
+#endif
+
+// Room for a Last-Modified date such as "Sun, 06 Nov 1994 08:49:37 GMT"
+#define HTTP_CACHE_DATE_SIZE 30
+
+// Number of URLs an HttpRamValidatorStore remembers validators for
+#ifndef HTTP_CACHE_RAM_ENTRIES
+#define HTTP_CACHE_RAM_ENTRIES 4
+#endif
+
+#define HTTP_HEADER_LAST_MODIFIED     "Last-Modified"
+#define HTTP_HEADER_IF_NONE_MATCH     "If-None-Match"
+#define HTTP_HEADER_IF_MODIFIED_SINCE "If-Modified-Since"
+
+// The validators for one URL.  Stores keep these as they are, so a change
+// to the layout (or to the sizes above) invalidates anything already saved
+struct HttpValidators
+{
+    // Hash of the server, port and path the validators are for.  0 for an
+    // empty entry
+    uint32_t iKey;
+    // A second, independent, hash of the same, so that another URL which
+    // happens to have the same iKey isn't given these validators
+    uint32_t iCheck;
+    char iETag[HTTP_CACHE_ETAG_SIZE];
+    char iLastModified[HTTP_CACHE_DATE_SIZE];
+};
+
+/** Somewhere to keep the validators for URLs between requests.  Derive from
+  this to keep them somewhere other than those provided: RAM (in
+  HttpRamValidatorStore, below), EEPROM (HttpEEPROMValidatorStore.h) or a
+  file (HttpFileValidatorStore.h, for host builds)
+*/
+class HttpValidatorStore
+{
+public:
+    /** Find the validators for a URL
+      @param aKey Key for the URL, as worked out by HttpCache
+      @param aValidators Filled in with the validators if they're found
+      @return true if validators were found for aKey.  HttpCache checks
+              that their iCheck matches too before using them
+    */
+    virtual bool load(uint32_t aKey, HttpValidators& aValidators) =0;
+
+    /** Keep the validators for a URL, replacing any already stored for it.
+      It's fine for a store to forget others to make room
+    */
+    virtual void save(const HttpValidators& aValidators) =0;
+};
+
+/** Validator store which keeps a few entries in RAM, so they're lost on
+  reset.  Each URL has one place it can go, chosen by its key
+*/
+class HttpRamValidatorStore : public HttpValidatorStore
+{
+public:
+    HttpRamValidatorStore();
+    virtual bool load(uint32_t aKey, HttpValidators& aValidators);
+    virtual void save(const HttpValidators& aValidators);
+protected:
+    HttpValidators iEntries[HTTP_CACHE_RAM_ENTRIES];
+};
+
+/** Makes GET requests which only download the body if it has changed since
+  the last time.  The ETag and Last-Modified headers of each response are
+  kept in an HttpValidatorStore, and sent back in If-None-Match and
+  If-Modified-Since headers next time.  If the server replies
+  304 Not Modified, the resource hasn't changed and there's no body.
+  HttpCache uses captureHeaders() on the HttpClient for its own purposes
+*/
+class HttpCache
+{
+public:
+    HttpCache(HttpClient& aHttp, HttpValidatorStore& aStore);
+
+    /** Make a GET request, and read the response status and headers.
+      If it returns 200, read the body from the HttpClient as normal, then
+      call commit() once you've dealt with it successfully.
+      @param aServerName  Name of the server being connected to
+      @param aServerPort  Port to connect to on the server
+      @param aURLPath     Url to request
+      @param aUserAgent   User-Agent string to send.  If NULL the default
+                          user-agent kUserAgent will be sent
+      @return The status code of the response (where 304 means our copy is
+              still up to date), else an error
+    */
+    int get(const char* aServerName, uint16_t aServerPort, const char* aURLPath,
+            const char* aUserAgent =NULL);
+    int get(const char* aServerName, const char* aURLPath, const char* aUserAgent =NULL)
+      { return get(aServerName, HttpClient::kHttpPort, aURLPath, aUserAgent); }
+
+    /** Test whether the last get() found that our copy was up to date
+      @return true if the server replied 304 Not Modified
+    */
+    bool cacheHit() { return iCacheHit; };
+
+    /** Save the validators from the last response, once the body has been
+      dealt with.  They aren't saved before then, so that if the download
+      fails we won't be told next time that our (old) copy is up to date
+    */
+    void commit();
+
+protected:
+    HttpClient* iHttp;
+    HttpValidatorStore* iStore;
+    // The validators we've got for the URL of the last request
+    HttpValidators iValidators;
+    // Where the ETag and Last-Modified headers are captured to
+    char iHeaderBuffer[HTTP_CACHE_ETAG_SIZE + HTTP_CACHE_DATE_SIZE];
+    bool iCacheHit;
+    // Whether iValidators holds new validators waiting for commit()
+    bool iPending;
+};
+
+#endif
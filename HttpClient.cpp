@@ -9,13 +9,41 @@
 #endif
 
 // Initialize constants
-const char* HttpClient::kUserAgent = "Arduino/2.2.0";
-const char* HttpClient::kContentLengthPrefix = HTTP_HEADER_CONTENT_LENGTH ": ";
+const char* HttpClient::kUserAgent = HTTP_USER_AGENT;
+// Psuedo-regexp we're expecting before the status-code
+const char* HttpClient::kStatusPrefix = "HTTP/*.* ";
+// The headers we need to know about, in the order of tHeaderId
+const char* HttpClient::kHeaderNames[kNumHeaders] = {
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_CONTENT_RANGE,
+    HTTP_HEADER_CONTENT_ENCODING,
+    HTTP_HEADER_LOCATION
+};
+const char* HttpClient::kHeaderValueClose = HTTP_HEADER_VALUE_CLOSE;
+const char* HttpClient::kHeaderValueChunked = HTTP_HEADER_VALUE_CHUNKED;
+const char* HttpClient::kHeaderValueGzip = HTTP_HEADER_VALUE_GZIP;
+const char* HttpClient::kHeaderValueXGzip = HTTP_HEADER_VALUE_X_GZIP;
+const char* HttpClient::kHeaderValueDeflate = HTTP_HEADER_VALUE_DEFLATE;
 
 #ifdef PROXY_ENABLED // currently disabled as introduces dependency on Dns.h in Ethernet
 HttpClient::HttpClient(Client& aClient, const char* aProxy, uint16_t aProxyPort)
- : iClient(&aClient), iProxyPort(aProxyPort)
+ : iClient(&aClient), iRequest(&aClient), iRxStart(0), iRxEnd(0), iDecoder(NULL), iResolver(NULL), iProxyPort(aProxyPort),
+   iHttpResponseTimeout(kHttpResponseTimeout), iLastReadTime(0),
+   iConnectTimeout(0), iFirstByteTimeout(0), iRequestDeadline(0),
+   iRequestStartTime(0), iRequestSentTime(0),
+   iWaitForDataMinDelay(kHttpWaitForDataMinDelay),
+   iWaitForDataMaxDelay(kHttpWaitForDataMaxDelay),
+   iWaitForDataCallback(NULL), iKeepAlive(false), iContinueTimeout(0),
+   iServerNameKept(false), iServerPort(0),
+   iCaptureNames(NULL), iCaptureCount(0), iCaptureBuffer(NULL), iCaptureBufferSize(0),
+   iRequestPath(NULL), iRequestReusedConnection(false), iMaxRedirects(0), iRedirectCount(0), iRedirectBuffer(NULL), iRedirectBufferSize(0)
+#if HTTP_METRICS
+   , iMetricsCallback(NULL), iMetricsContext(NULL), iMetricsPending(false)
+#endif
 {
+  iServerName[0] = '\0';
   resetState();
   if (aProxy)
   {
@@ -29,8 +57,21 @@ HttpClient::HttpClient(Client& aClient, const char* aProxy, uint16_t aProxyPort)
 }
 #else
 HttpClient::HttpClient(Client& aClient)
- : iClient(&aClient), iProxyPort(0)
+ : iClient(&aClient), iRequest(&aClient), iRxStart(0), iRxEnd(0), iDecoder(NULL), iResolver(NULL), iProxyPort(0),
+   iHttpResponseTimeout(kHttpResponseTimeout), iLastReadTime(0),
+   iConnectTimeout(0), iFirstByteTimeout(0), iRequestDeadline(0),
+   iRequestStartTime(0), iRequestSentTime(0),
+   iWaitForDataMinDelay(kHttpWaitForDataMinDelay),
+   iWaitForDataMaxDelay(kHttpWaitForDataMaxDelay),
+   iWaitForDataCallback(NULL), iKeepAlive(false), iContinueTimeout(0),
+   iServerNameKept(false), iServerPort(0),
+   iCaptureNames(NULL), iCaptureCount(0), iCaptureBuffer(NULL), iCaptureBufferSize(0),
+   iRequestPath(NULL), iRequestReusedConnection(false), iMaxRedirects(0), iRedirectCount(0), iRedirectBuffer(NULL), iRedirectBufferSize(0)
+#if HTTP_METRICS
+   , iMetricsCallback(NULL), iMetricsContext(NULL), iMetricsPending(false)
+#endif
 {
+  iServerName[0] = '\0';
   resetState();
 }
 #endif
@@ -39,56 +80,155 @@ void HttpClient::resetState()
 {
   iState = eIdle;
   iStatusCode = 0;
-  iContentLength = 0;
+  iStatusPtr = kStatusPrefix;
+  iContentLength = kNoContentLengthHeader;
   iBodyLengthConsumed = 0;
-  iContentLengthPtr = kContentLengthPrefix;
-  iHttpResponseTimeout = kHttpResponseTimeout;
+  iRangeStart = 0;
+  iRangeTotal = kNoContentLengthHeader;
+  startHeaderLine();
+  clearCapturedHeaders();
+  iServerWillClose = false;
+  iIsChunked = false;
+  iChunkState = eChunkSize;
+  iChunkLength = 0;
+  iContentEncoding = kNoContentEncoding;
+  iDecoding = false;
+  iDecodedPeek = -1;
+  iResponseStarted = false;
+  iCapturingLocation = false;
+  iLocationFound = false;
+  iRedirectChecked = false;
+  iPipelined = 0;
+  iHeadRequests = 0;
 }
 
 void HttpClient::stop()
+{
+  metricsFinish();
+  closeConnection();
+  resetState();
+}
+
+void HttpClient::closeConnection()
 {
   iClient->stop();
+  // Anything left in the receive buffer belonged to that connection
+  iRxStart = 0;
+  iRxEnd = 0;
+}
+
+bool HttpClient::connectionReusable()
+{
+  return iKeepAlive && !iServerWillClose && endOfRawBodyReached() &&
+         (iPipelined == 0) && iClient->connected();
+}
+
+void HttpClient::endPreviousResponse()
+{
+  metricsFinish();
+  if (!connectionReusable())
+  {
+    closeConnection();
+  }
   resetState();
 }
 
+bool HttpClient::isCurrentServer(const char* aServerName, const IPAddress& aServerAddress, uint16_t aServerPort)
+{
+  if (!iServerNameKept || (aServerAddress != iServerAddress) || (aServerPort != iServerPort))
+  {
+    return false;
+  }
+  // Server names are case-insensitive
+  return aServerName ? (strcasecmp(aServerName, iServerName) == 0) : (iServerName[0] == '\0');
+}
+
+bool HttpClient::reuseConnection(const char* aServerName, const IPAddress& aServerAddress, uint16_t aServerPort)
+{
+  if (iClient->connected())
+  {
+    if (iKeepAlive && isCurrentServer(aServerName, aServerAddress, aServerPort))
+    {
+      return true;
+    }
+    // It's a connection to somewhere else, we don't want it
+    closeConnection();
+  }
+  // Remember who we're about to connect to.  If the name is too long to
+  // keep, the connection won't be used again
+  iServerNameKept = !aServerName || (strlen(aServerName) <= HTTP_SERVER_NAME_LENGTH);
+  strcpy(iServerName, (aServerName && iServerNameKept) ? aServerName : "");
+  iServerAddress = aServerAddress;
+  iServerPort = aServerPort;
+  return false;
+}
+
 void HttpClient::beginRequest()
 {
+  if (iKeepAlive && (iState > eRequestStarted))
+  {
+    // Tidy up after the last request
+    endPreviousResponse();
+  }
   iState = eRequestStarted;
 }
 
 int HttpClient::startRequest(const char* aServerName, uint16_t aServerPort, const char* aURLPath, const char* aHttpMethod, const char* aUserAgent)
 {
+    if (iKeepAlive && (iState > eRequestStarted))
+    {
+        // Tidy up after the last request
+        endPreviousResponse();
+    }
     tHttpState initialState = iState;
     if ((eIdle != iState) && (eRequestStarted != iState))
     {
         return HTTP_ERROR_API;
     }
+    metricsStart();
+    iRequestStartTime = millis();
+    // Remember the request, in case we're redirected
+    iRequestServerName = aServerName;
+    iRequestServerPort = aServerPort;
+    iRequestPath = aURLPath;
+    iRequestMethod = aHttpMethod;
+    iRequestUserAgent = aUserAgent;
+    iRequestHadBody = false;
+    iRedirectCount = 0;
 
+    bool reused = reuseConnection(aServerName, IPAddress(0,0,0,0), aServerPort);
+    iRequestReusedConnection = reused;
+    if (reused)
+    {
+        // We're still connected from the last request, so nothing to do
+    }
 #ifdef PROXY_ENABLED
-    if (iProxyPort)
+    else if (iProxyPort)
     {
-        if (!iClient->connect(iProxyAddress, iProxyPort) > 0)
+        if (!(iClient->connect(iProxyAddress, iProxyPort) > 0))
         {
 #ifdef LOGGING
             Serial.println("Proxy connection failed");
 #endif
-            return HTTP_ERROR_CONNECTION_FAILED;
+            return connectFailed();
         }
     }
-    else
 #endif
+    else
     {
-        if (!iClient->connect(aServerName, aServerPort) > 0)
+        int ret = connectByName(aServerName, aServerPort);
+        if (ret != HTTP_SUCCESS)
         {
-#ifdef LOGGING
-            Serial.println("Connection failed");
-#endif
-            return HTTP_ERROR_CONNECTION_FAILED;
+            return ret;
         }
     }
 
+    metricsConnected(reused);
+
     // Now we're connected, send the first part of the request
     int ret = sendInitialHeaders(aServerName, IPAddress(0,0,0,0), aServerPort, aURLPath, aHttpMethod, aUserAgent);
+    // Anything from sendHeader(), etc. after this is the caller's
+    iRequestHadHeaders = false;
     if ((initialState == eIdle) && (HTTP_SUCCESS == ret))
     {
         // This was a simple version of the API, so terminate the headers now
@@ -101,35 +241,52 @@ int HttpClient::startRequest(const char* aServerName, uint16_t aServerPort, cons
 
 int HttpClient::startRequest(const IPAddress& aServerAddress, const char* aServerName, uint16_t aServerPort, const char* aURLPath, const char* aHttpMethod, const char* aUserAgent)
 {
+    if (iKeepAlive && (iState > eRequestStarted))
+    {
+        // Tidy up after the last request
+        endPreviousResponse();
+    }
     tHttpState initialState = iState;
     if ((eIdle != iState) && (eRequestStarted != iState))
     {
         return HTTP_ERROR_API;
     }
+    metricsStart();
+    iRequestStartTime = millis();
+    // We can't make this request again for a redirect
+    iRequestPath = NULL;
+    iRedirectCount = 0;
 
+    bool reused = reuseConnection(aServerName, aServerAddress, aServerPort);
+    if (reused)
+    {
+        // We're still connected from the last request, so nothing to do
+    }
 #ifdef PROXY_ENABLED
-    if (iProxyPort)
+    else if (iProxyPort)
     {
-        if (!iClient->connect(iProxyAddress, iProxyPort) > 0)
+        if (!(iClient->connect(iProxyAddress, iProxyPort) > 0))
         {
 #ifdef LOGGING
             Serial.println("Proxy connection failed");
 #endif
-            return HTTP_ERROR_CONNECTION_FAILED;
+            return connectFailed();
         }
     }
-    else
 #endif
+    else
     {
-        if (!iClient->connect(aServerAddress, aServerPort) > 0)
+        if (!(iClient->connect(aServerAddress, aServerPort) > 0))
         {
 #ifdef LOGGING
             Serial.println("Connection failed");
 #endif
-            return HTTP_ERROR_CONNECTION_FAILED;
+            return connectFailed();
         }
     }
 
+    metricsConnected(reused);
+
     // Now we're connected, send the first part of the request
     int ret = sendInitialHeaders(aServerName, aServerAddress, aServerPort, aURLPath, aHttpMethod, aUserAgent);
     if ((initialState == eIdle) && (HTTP_SUCCESS == ret))
@@ -147,44 +304,50 @@ int HttpClient::sendInitialHeaders(const char* aServerName, IPAddress aServerIP,
 #ifdef LOGGING
     Serial.println("Connected");
 #endif
+    iRequest.resetWriteCount();
+    if (strcmp(aHttpMethod, HTTP_METHOD_HEAD) == 0)
+    {
+        // The response to this request won't have a body
+        iHeadRequests |= (1 << iPipelined);
+    }
     // Send the HTTP command, i.e. "GET /somepath/ HTTP/1.0"
-    iClient->print(aHttpMethod);
-    iClient->print(" ");
+    iRequest.print(aHttpMethod);
+    iRequest.print(" ");
 #ifdef PROXY_ENABLED
     if (iProxyPort)
     {
       // We're going through a proxy, send a full URL
-      iClient->print("http://");
+      iRequest.print("http://");
       if (aServerName)
       {
         // We've got a server name, so use it
-        iClient->print(aServerName);
+        iRequest.print(aServerName);
       }
       else
       {
         // We'll have to use the IP address
-        iClient->print(aServerIP);
+        iRequest.print(aServerIP);
       }
       if (aPort != kHttpPort)
       {
-        iClient->print(":");
-        iClient->print(aPort);
+        iRequest.print(":");
+        iRequest.print(aPort);
       }
     }
 #endif
-    iClient->print(aURLPath);
-    iClient->println(" HTTP/1.1");
+    iRequest.print(aURLPath);
+    iRequest.println(" HTTP/1.1");
     // The host header, if required
     if (aServerName)
     {
-        iClient->print("Host: ");
-        iClient->print(aServerName);
+        iRequest.print("Host: ");
+        iRequest.print(aServerName);
         if (aPort != kHttpPort)
         {
-          iClient->print(":");
-          iClient->print(aPort);
+          iRequest.print(":");
+          iRequest.print(aPort);
         }
-        iClient->println();
+        iRequest.println();
     }
     // And user-agent string
     if (aUserAgent)
@@ -195,87 +358,262 @@ int HttpClient::sendInitialHeaders(const char* aServerName, IPAddress aServerIP,
     {
         sendHeader(HTTP_HEADER_USER_AGENT, kUserAgent);
     }
-    // We don't support persistent connections, so tell the server to
-    // close this connection after we're done
-    sendHeader(HTTP_HEADER_CONNECTION, "close");
+    sendSettingsHeaders();
 
     // Everything has gone well
     iState = eRequestStarted;
     return HTTP_SUCCESS;
 }
 
+void HttpClient::sendSettingsHeaders()
+{
+    // Unless the user wants a persistent connection, tell the server to
+    // close this connection after we're done
+    if (iKeepAlive)
+    {
+        sendHeader(HTTP_HEADER_CONNECTION, HTTP_HEADER_VALUE_KEEP_ALIVE);
+    }
+    else
+    {
+        sendHeader(HTTP_HEADER_CONNECTION, HTTP_HEADER_VALUE_CLOSE);
+    }
+    if (iDecoder)
+    {
+        sendHeader(HTTP_HEADER_ACCEPT_ENCODING, HTTP_HEADER_VALUE_GZIP ", " HTTP_HEADER_VALUE_DEFLATE);
+    }
+}
+
+int HttpClient::startRequest(const HttpRequestTemplate& aTemplate, const char* aQuery)
+{
+    if (iKeepAlive && (iState > eRequestStarted))
+    {
+        // Tidy up after the last request
+        endPreviousResponse();
+    }
+    tHttpState initialState = iState;
+    if ((eIdle != iState) && (eRequestStarted != iState))
+    {
+        return HTTP_ERROR_API;
+    }
+#ifdef PROXY_ENABLED
+    if (iProxyPort)
+    {
+        // The request line would need the full URL
+        return HTTP_ERROR_API;
+    }
+#endif
+    metricsStart();
+    iRequestStartTime = millis();
+    // We can't make this request again for a redirect
+    iRequestPath = NULL;
+    iRedirectCount = 0;
+
+    bool reused = reuseConnection(aTemplate.iServerName, IPAddress(0,0,0,0), aTemplate.iServerPort);
+    if (reused)
+    {
+        // We're still connected from the last request, so nothing to do
+    }
+    else
+    {
+        int ret = connectByName(aTemplate.iServerName, aTemplate.iServerPort);
+        if (ret != HTTP_SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    metricsConnected(reused);
+
+    // Now we're connected, send the first part of the request.  The fixed
+    // parts all go into the send buffer, so they leave in as few writes as
+    // will hold them
+    iRequest.resetWriteCount();
+    if (aTemplate.iIsHead)
+    {
+        // The response to this request won't have a body
+        iHeadRequests |= (1 << iPipelined);
+    }
+    iRequest.writeProgmem(aTemplate.iRequestLine);
+    if (aQuery)
+    {
+        iRequest.print(aQuery);
+    }
+    iRequest.writeProgmem(aTemplate.iHeaders);
+    sendSettingsHeaders();
+    iState = eRequestStarted;
+
+    if (initialState == eIdle)
+    {
+        // This was a simple version of the API, so terminate the headers now
+        finishHeaders();
+    }
+    // else we'll call it in endRequest or in the first call to print, etc.
+
+    return HTTP_SUCCESS;
+}
+
+int HttpClient::queueRequest(const char* aServerName, uint16_t aServerPort, const char* aURLPath, const char* aHttpMethod, const char* aUserAgent)
+{
+    if (!iKeepAlive || (iState < eRequestSent) || (iPipelined >= kMaxPipelinedRequests) ||
+        !iClient->connected() || !isCurrentServer(aServerName, IPAddress(0,0,0,0), aServerPort))
+    {
+        // We can only pipeline requests to the server we're already talking to
+        return HTTP_ERROR_API;
+    }
+
+    // Send the request, but without disturbing the state of the response
+    // we're currently processing
+    tHttpState state = iState;
+    unsigned long lastReadTime = iLastReadTime;
+    unsigned long requestSentTime = iRequestSentTime;
+    uint16_t writeCount = iRequest.writeCount();
+    uint32_t bytesWritten = iRequest.bytesWritten();
+#if HTTP_METRICS
+    HttpMetrics metrics = iMetrics;
+    unsigned long metricsSentTime = iMetricsSent;
+#endif
+    iPipelined++;
+    int ret = sendInitialHeaders(aServerName, IPAddress(0,0,0,0), aServerPort, aURLPath, aHttpMethod, aUserAgent);
+    finishHeaders();
+    // We only remember the details of one request, so none of the responses
+    // on this connection can be followed as a redirect or retried now
+    iRequestPath = NULL;
+    iState = state;
+    iLastReadTime = lastReadTime;
+    iRequestSentTime = requestSentTime;
+    iRequest.setWriteCount(writeCount, bytesWritten);
+#if HTTP_METRICS
+    iMetrics = metrics;
+    iMetricsSent = metricsSentTime;
+#endif
+    return ret;
+}
+
+int HttpClient::nextResponse()
+{
+    if (iPipelined == 0)
+    {
+        return HTTP_ERROR_API;
+    }
+    if (!endOfRawBodyReached())
+    {
+        // We need to have finished with this response first
+        return HTTP_ERROR_API;
+    }
+    if (iServerWillClose || !connected())
+    {
+        // The server isn't going to answer the rest of the requests.  Leave
+        // iPipelined alone so the caller can see how many went unanswered
+        return HTTP_ERROR_CONNECTION_CLOSED;
+    }
+
+    // Get ready to read the next response.  It was sent while we were
+    // reading the last one, so there's nothing to time until it arrives
+    uint8_t pipelined = iPipelined - 1;
+    uint8_t headRequests = iHeadRequests >> 1;
+    metricsFinish();
+    resetState();
+    metricsStart();
+    metricsConnected(true);
+    metricsSent();
+    iPipelined = pipelined;
+    iHeadRequests = headRequests;
+    iRedirectCount = 0;
+    iState = eRequestSent;
+    iLastReadTime = millis();
+    // Its timeouts start now too.  Some of it may be here already
+    iRequestStartTime = iLastReadTime;
+    iRequestSentTime = iLastReadTime;
+    iResponseStarted = (clientAvailable() > 0);
+    return HTTP_SUCCESS;
+}
+
 void HttpClient::sendHeader(const char* aHeader)
 {
-    iClient->println(aHeader);
+    iRequestHadHeaders = true;
+    iRequest.println(aHeader);
 }
 
 void HttpClient::sendHeader(const char* aHeaderName, const char* aHeaderValue)
 {
-    iClient->print(aHeaderName);
-    iClient->print(": ");
-    iClient->println(aHeaderValue);
+    iRequestHadHeaders = true;
+    iRequest.print(aHeaderName);
+    iRequest.print(": ");
+    iRequest.println(aHeaderValue);
 }
 
 void HttpClient::sendHeader(const char* aHeaderName, const int aHeaderValue)
 {
-    iClient->print(aHeaderName);
-    iClient->print(": ");
-    iClient->println(aHeaderValue);
+    iRequestHadHeaders = true;
+    iRequest.print(aHeaderName);
+    iRequest.print(": ");
+    iRequest.println(aHeaderValue);
+}
+
+void HttpClient::sendRange(unsigned long aFirstByte)
+{
+    iRequestHadHeaders = true;
+    iRequest.print(HTTP_HEADER_RANGE);
+    iRequest.print(": bytes=");
+    iRequest.print(aFirstByte);
+    iRequest.println("-");
 }
 
 void HttpClient::sendBasicAuth(const char* aUser, const char* aPassword)
 {
-    // Send the initial part of this header line
-    iClient->print("Authorization: Basic ");
-    // Now Base64 encode "aUser:aPassword" and send that
-    // This seems trickier than it should be but it's mostly to avoid either
-    // (a) some arbitrarily sized buffer which hopes to be big enough, or
-    // (b) allocating and freeing memory
-    // ...so we'll loop through 3 bytes at a time, outputting the results as we
-    // go.
-    // In Base64, each 3 bytes of unencoded data become 4 bytes of encoded data
-    unsigned char input[3];
-    unsigned char output[5]; // Leave space for a '\0' terminator so we can easily print
-    int userLen = strlen(aUser);
-    int passwordLen = strlen(aPassword);
-    int inputOffset = 0;
-    for (int i = 0; i < (userLen+1+passwordLen); i++)
+    // Each part of "aUser:aPassword" is Base64 encoded straight into the
+    // room left in the send buffer as it's added, so the header line goes
+    // out along with the rest unless it's too long to fit
+    iRequestHadHeaders = true;
+    iRequest.print("Authorization: Basic ");
+    b64_encode_state state;
+    b64_encode_init(&state);
+    const char* parts[] = { aUser, ":", aPassword };
+    for (uint8_t i = 0; i < 3; i++)
     {
-        // Copy the relevant input byte into the input
-        if (i < userLen)
-        {
-            input[inputOffset++] = aUser[i];
-        }
-        else if (i == userLen)
-        {
-            input[inputOffset++] = ':';
-        }
-        else
-        {
-            input[inputOffset++] = aPassword[i-(userLen+1)];
-        }
-        // See if we've got a chunk to encode
-        if ( (inputOffset == 3) || (i == userLen+passwordLen) )
+        const unsigned char* input = (const unsigned char*)parts[i];
+        int inputLen = strlen(parts[i]);
+        while (inputLen > 0)
         {
-            // We've either got to a 3-byte boundary, or we've reached then end
-            b64_encode(input, inputOffset, output, 4);
-            // NUL-terminate the output string
-            output[4] = '\0';
-            // And write it out
-            iClient->print((char*)output);
-// FIXME We might want to fill output with '=' characters if b64_encode doesn't
-// FIXME do it for us when we're encoding the final chunk
-            inputOffset = 0;
+            // In Base64, each 3 bytes of input become 4 characters, so this
+            // is as much as there's room to encode
+            size_t room;
+            uint8_t* space = iRequest.space(room);
+            int len = (room / 4) * 3;
+            if (len == 0)
+            {
+                iRequest.flush();
+                continue;
+            }
+            if (len > inputLen)
+            {
+                len = inputLen;
+            }
+            iRequest.commit(b64_encode_update(&state, input, len, space, room));
+            input += len;
+            inputLen -= len;
         }
     }
-    // And end the header we've sent
-    iClient->println();
+    // Leave room for the final group
+    size_t room;
+    uint8_t* space = iRequest.space(room);
+    if (room < 4)
+    {
+        iRequest.flush();
+        space = iRequest.space(room);
+    }
+    iRequest.commit(b64_encode_final(&state, space, room));
+    iRequest.println();
 }
 
 void HttpClient::finishHeaders()
 {
-    iClient->println();
+    iRequest.println();
+    iRequest.flush();
     iState = eRequestSent;
+    iLastReadTime = millis();
+    iRequestSentTime = iLastReadTime;
+    metricsSent();
 }
 
 void HttpClient::endRequest()
@@ -288,262 +626,1365 @@ void HttpClient::endRequest()
     // else the end of headers has already been sent, so nothing to do here
 }
 
-int HttpClient::responseStatusCode()
+int HttpClient::sendBody(HttpBodySource& aSource)
 {
-    if (iState < eRequestSent)
+    if (iState != eRequestStarted)
     {
         return HTTP_ERROR_API;
     }
-    // The first line will be of the form Status-Line:
-    //   HTTP-Version SP Status-Code SP Reason-Phrase CRLF
-    // Where HTTP-Version is of the form:
-    //   HTTP-Version   = "HTTP" "/" 1*DIGIT "." 1*DIGIT
 
-    char c = '\0';
-    do
+    iRequestHadBody = true;
+    long length = aSource.length();
+    bool chunked = (length < 0);
+    if (chunked)
     {
-        // Make sure the status code is reset, and likewise the state.  This
-        // lets us easily cope with 1xx informational responses by just
-        // ignoring them really, and reading the next line for a proper response
-        iStatusCode = 0;
-        iState = eRequestSent;
+        sendHeader(HTTP_HEADER_TRANSFER_ENCODING, HTTP_HEADER_VALUE_CHUNKED);
+    }
+    else
+    {
+        iRequest.print(HTTP_HEADER_CONTENT_LENGTH);
+        iRequest.print(": ");
+        iRequest.println(length);
+    }
+    bool expectContinue = (iContinueTimeout > 0) && (length != 0);
+    if (expectContinue)
+    {
+        sendHeader("Expect: 100-continue");
+    }
+    // The end of the headers goes out with the first block of the body,
+    // unless we need to hear back from the server first
+    iRequest.println();
+    iState = eRequestSent;
+    if (expectContinue)
+    {
+        iRequest.flush();
+        int status = waitForContinue();
+        if (status < 0)
+        {
+            stop();
+            return status;
+        }
+        else if (status >= 200)
+        {
+            // The server has answered without needing the body.  We don't
+            // send it, so it won't be able to tell where this request ends
+            // and any following one starts
+            iServerWillClose = true;
+            return HTTP_SUCCESS;
+        }
+    }
 
-        unsigned long timeoutStart = millis();
-        // Psuedo-regexp we're expecting before the status-code
-        const char* statusPrefix = "HTTP/*.* ";
-        const char* statusPtr = statusPrefix;
-        // Whilst we haven't timed out & haven't reached the end of the headers
-        while ((c != '\n') && 
-               ( (millis() - timeoutStart) < iHttpResponseTimeout ))
+    // The body is read straight into the room left in iRequest's buffer, so
+    // the first block goes out with the headers.  Each chunk is its size in
+    // hex and CRLF, the data, then CRLF, so we leave room around the data
+    // for those.  The size is padded with leading zeros to the width we
+    // left for it, in case less than we asked for is read
+    long sent = 0;
+    int ret = HTTP_SUCCESS;
+    while (chunked || (sent < length))
+    {
+        size_t room;
+        uint8_t* block = iRequest.space(room);
+        if (room < (chunked ? kMinChunkSpace : 1))
         {
-            if (available())
+            iRequest.flush();
+            block = iRequest.space(room);
+        }
+        size_t digits = 0;
+        size_t size = room;
+        if (chunked)
+        {
+            // Work out how many digits the size needs
+            do
             {
-                c = read();
-                if (c != -1)
-                {
-                    switch(iState)
-                    {
-                    case eRequestSent:
-                        // We haven't reached the status code yet
-                        if ( (*statusPtr == '*') || (*statusPtr == c) )
-                        {
-                            // This character matches, just move along
-                            statusPtr++;
-                            if (*statusPtr == '\0')
-                            {
-                                // We've reached the end of the prefix
-                                iState = eReadingStatusCode;
-                            }
-                        }
-                        else
-                        {
-                            return HTTP_ERROR_INVALID_RESPONSE;
-                        }
-                        break;
-                    case eReadingStatusCode:
-                        if (isdigit(c))
-                        {
-                            // This assumes we won't get more than the 3 digits we
-                            // want
-                            iStatusCode = iStatusCode*10 + (c - '0');
-                        }
-                        else
-                        {
-                            // We've reached the end of the status code
-                            // We could sanity check it here or double-check for ' '
-                            // rather than anything else, but let's be lenient
-                            iState = eStatusCodeRead;
-                        }
-                        break;
-                    case eStatusCodeRead:
-                        // We're just waiting for the end of the line now
-                        break;
-                    };
-                    // We read something, reset the timeout counter
-                    timeoutStart = millis();
-                }
-            }
-            else
+                digits++;
+                size = room - digits - 4;
+            } while ((size >> (4*digits)) > 0);
+        }
+        else if ((long)size > length - sent)
+        {
+            // Don't send more than we said we would
+            size = length - sent;
+        }
+        int len = aSource.read(block + (chunked ? digits + 2 : 0), size);
+        if (len < 0)
+        {
+            ret = len;
+            break;
+        }
+        else if (len == 0)
+        {
+            // That's the end of the body, which is fine unless we were told
+            // there'd be more
+            ret = chunked ? HTTP_SUCCESS : HTTP_ERROR_BODY_TOO_SHORT;
+            break;
+        }
+        sent += len;
+        if (chunked)
+        {
+            int remaining = len;
+            for (size_t i = digits; i > 0; i--)
             {
-                // We haven't got any data, so let's pause to allow some to
-                // arrive
-                delay(kHttpWaitForDataDelay);
+                block[i-1] = "0123456789abcdef"[remaining & 0x0F];
+                remaining >>= 4;
             }
+            block[digits] = '\r';
+            block[digits + 1] = '\n';
+            block[digits + 2 + len] = '\r';
+            block[digits + 2 + len + 1] = '\n';
+            iRequest.commit(digits + 4 + len);
         }
-        if ( (c == '\n') && (iStatusCode < 200) )
+        else
         {
-            // We've reached the end of an informational status line
-            c = '\0'; // Clear c so we'll go back into the data reading loop
+            iRequest.commit(len);
         }
     }
-    // If we've read a status code successfully but it's informational (1xx)
-    // loop back to the start
-    while ( (iState == eStatusCodeRead) && (iStatusCode < 200) );
 
-    if ( (c == '\n') && (iState == eStatusCodeRead) )
-    {
-        // We've read the status-line successfully
-        return iStatusCode;
-    }
-    else if (c != '\n')
+    if (ret != HTTP_SUCCESS)
     {
-        // We must've timed out before we reached the end of the line
-        return HTTP_ERROR_TIMED_OUT;
+        // The server is still waiting for the rest of the body, so this
+        // connection is no use now
+        stop();
+        return ret;
     }
-    else
+    if (chunked)
     {
-        // This wasn't a properly formed status line, or at least not one we
-        // could understand
-        return HTTP_ERROR_INVALID_RESPONSE;
+        // The last chunk is empty, and we don't send any trailers
+        iRequest.print("0\r\n\r\n");
     }
+    iRequest.flush();
+    iLastReadTime = millis();
+    iRequestSentTime = iLastReadTime;
+    metricsSent();
+    return HTTP_SUCCESS;
 }
 
-int HttpClient::skipResponseHeaders()
+int HttpClient::waitForContinue()
 {
-    // Just keep reading until we finish reading the headers or time out
-    unsigned long timeoutStart = millis();
-    // Whilst we haven't timed out & haven't reached the end of the headers
-    while ((!endOfHeadersReached()) && 
-           ( (millis() - timeoutStart) < iHttpResponseTimeout ))
+    iContinueReceived = false;
+    unsigned long start = millis();
+    uint32_t waitDelay = iWaitForDataMinDelay;
+    while (true)
     {
-        if (available())
+        int ret = readStatusLine();
+        if (iContinueReceived)
         {
-            (void)readHeader();
-            // We read something, reset the timeout counter
-            timeoutStart = millis();
+            // Even if the final response has turned up as well, it came
+            // after the go ahead, so it's expecting the body
+            return 100;
         }
-        else
+        else if (ret != HTTP_POLL_IN_PROGRESS)
         {
-            // We haven't got any data, so let's pause to allow some to
-            // arrive
-            delay(kHttpWaitForDataDelay);
+            // Either an error, or the final response
+            return ret;
         }
-    }
-    if (endOfHeadersReached())
-    {
-        // Success
-        return HTTP_SUCCESS;
-    }
-    else
-    {
-        // We must've timed out
-        return HTTP_ERROR_TIMED_OUT;
+        else if ((millis() - start) >= iContinueTimeout)
+        {
+            return 100;
+        }
+        else if (deadlinePassed())
+        {
+            return HTTP_ERROR_DEADLINE_EXCEEDED;
+        }
+        waitForData(waitDelay);
     }
 }
 
-bool HttpClient::endOfBodyReached()
+size_t HttpClient::write(uint8_t aByte)
+{
+    return write(&aByte, 1);
+}
+
+size_t HttpClient::write(const uint8_t *aBuffer, size_t aSize)
 {
-    if (endOfHeadersReached() && (contentLength() != kNoContentLengthHeader))
+    iRequestHadBody = true;
+    if (iState < eRequestSent)
     {
-        // We've got to the body and we know how long it will be
-        return (iBodyLengthConsumed >= contentLength());
+        // This is the start of the body, so end the headers.  We don't flush
+        // them yet, so that any of the body which fits in the buffer goes
+        // out in the same write
+        iRequest.println();
+        iState = eRequestSent;
+        iLastReadTime = millis();
     }
-    return false;
+    size_t ret = iRequest.write(aBuffer, aSize);
+    iRequest.flush();
+    // The server won't answer until it has all of the body
+    iRequestSentTime = millis();
+    metricsSent();
+    return ret;
 }
 
-int HttpClient::read()
+size_t HttpClient::RequestBuffer::write(uint8_t aByte)
 {
-#if 0 // Fails on WiFi because multi-byte read seems to be broken
-    uint8_t b[1];
-    int ret = read(b, 1);
-    if (ret == 1)
+    if (iLength == sizeof(iBuffer))
     {
-        return b[0];
+        flush();
     }
-    else
+    iBuffer[iLength++] = aByte;
+    return 1;
+}
+
+size_t HttpClient::RequestBuffer::write(const uint8_t *aBuffer, size_t aSize)
+{
+    size_t ret = aSize;
+    if ((iLength > 0) && (aSize > sizeof(iBuffer) - iLength))
     {
-        return -1;
+        // Top up what's already buffered and send it
+        size_t toCopy = sizeof(iBuffer) - iLength;
+        memcpy(iBuffer+iLength, aBuffer, toCopy);
+        iLength += toCopy;
+        aBuffer += toCopy;
+        aSize -= toCopy;
+        flush();
     }
-#else
-    int ret = iClient->read();
-    if (ret >= 0)
+    if (aSize >= sizeof(iBuffer))
     {
-        if (endOfHeadersReached() && iContentLength > 0)
-	{
-            // We're outputting the body now and we've seen a Content-Length header
-            // So keep track of how many bytes are left
-            iBodyLengthConsumed++;
-	}
+        // No point copying this, it'd only fill the buffer anyway
+        iWriteCount++;
+        iBytesWritten += aSize;
+        return (ret - aSize) + iClient->write(aBuffer, aSize);
     }
+    memcpy(iBuffer+iLength, aBuffer, aSize);
+    iLength += aSize;
     return ret;
-#endif
 }
 
-int HttpClient::read(uint8_t *buf, size_t size)
+void HttpClient::RequestBuffer::writeProgmem(const char* aString)
 {
-    int ret =iClient->read(buf, size);
-    if (endOfHeadersReached() && iContentLength > 0)
+#ifdef __AVR__
+    // Copy it out of flash a piece at a time
+    uint8_t piece[16];
+    size_t length = 0;
+    char c;
+    while ((c = pgm_read_byte(aString++)) != '\0')
     {
-        // We're outputting the body now and we've seen a Content-Length header
-        // So keep track of how many bytes are left
-        if (ret >= 0)
-	{
-            iBodyLengthConsumed += ret;
-	}
+        piece[length++] = c;
+        if (length == sizeof(piece))
+        {
+            write(piece, length);
+            length = 0;
+        }
     }
-    return ret;
+    write(piece, length);
+#else
+    write((const uint8_t*)aString, strlen(aString));
+#endif
 }
 
-int HttpClient::readHeader()
+void HttpClient::RequestBuffer::flush()
 {
-    char c = read();
-
-    if (endOfHeadersReached())
+    if (iLength > 0)
     {
-        // We've passed the headers, but rather than return an error, we'll just
-        // act as a slightly less efficient version of read()
-        return c;
+        iWriteCount++;
+        iBytesWritten += iLength;
+        iClient->write(iBuffer, iLength);
+        iLength = 0;
     }
+}
 
-    // Whilst reading out the headers to whoever wants them, we'll keep an
-    // eye out for the "Content-Length" header
-    switch(iState)
+int HttpClient::connectByName(const char* aServerName, uint16_t aServerPort)
+{
+    int connected;
+    if (iResolver)
     {
-    case eStatusCodeRead:
-        // We're at the start of a line, or somewhere in the middle of reading
-        // the Content-Length prefix
-        if (*iContentLengthPtr == c)
+        IPAddress address;
+        if (!iResolver->lookup(aServerName, address))
         {
-            // This character matches, just move along
-            iContentLengthPtr++;
-            if (*iContentLengthPtr == '\0')
-            {
-                // We've reached the end of the prefix
-                iState = eReadingContentLength;
-                // Just in case we get multiple Content-Length headers, this
-                // will ensure we just get the value of the last one
-                iContentLength = 0;
-            }
+#ifdef LOGGING
+            Serial.println("DNS lookup failed");
+#endif
+            return HTTP_ERROR_DNS_FAILED;
         }
-        else if ((iContentLengthPtr == kContentLengthPrefix) && (c == '\r'))
+        connected = iClient->connect(address, aServerPort);
+        if (!(connected > 0))
         {
-            // We've found a '\r' at the start of a line, so this is probably
-            // the end of the headers
-            iState = eLineStartingCRFound;
+            // Next time it'll be looked up again, in case it has moved
+            iResolver->connectFailed(aServerName);
+        }
+    }
+    else
+    {
+        connected = iClient->connect(aServerName, aServerPort);
+    }
+    if (!(connected > 0))
+    {
+#ifdef LOGGING
+        Serial.println("Connection failed");
+#endif
+        return connectFailed();
+    }
+    return HTTP_SUCCESS;
+}
+
+int HttpClient::connectFailed()
+{
+    // Tell the caller whether it was because it took too long
+    if ((iConnectTimeout > 0) && ((millis() - iRequestStartTime) >= iConnectTimeout))
+    {
+        return HTTP_ERROR_CONNECT_TIMED_OUT;
+    }
+    if (deadlinePassed())
+    {
+        return HTTP_ERROR_DEADLINE_EXCEEDED;
+    }
+    return HTTP_ERROR_CONNECTION_FAILED;
+}
+
+int HttpClient::checkTimeouts()
+{
+    if (iState < eRequestSent)
+    {
+        // We're not waiting for anything
+        return HTTP_SUCCESS;
+    }
+    if (deadlinePassed())
+    {
+        return HTTP_ERROR_DEADLINE_EXCEEDED;
+    }
+    unsigned long now = millis();
+    if (!iResponseStarted && (iFirstByteTimeout > 0) &&
+        ((now - iRequestSentTime) >= iFirstByteTimeout))
+    {
+        return HTTP_ERROR_FIRST_BYTE_TIMED_OUT;
+    }
+    if ((now - iLastReadTime) >= iHttpResponseTimeout)
+    {
+        return HTTP_ERROR_TIMED_OUT;
+    }
+    return HTTP_SUCCESS;
+}
+
+int HttpClient::responseStatusCode()
+{
+    if (iState < eRequestSent)
+    {
+        return HTTP_ERROR_API;
+    }
+
+    int ret;
+    do
+    {
+        // Keep processing the status line until we've got it or time out
+        iLastReadTime = millis();
+        uint32_t waitDelay = iWaitForDataMinDelay;
+        while ((ret = readStatusLine()) == HTTP_POLL_IN_PROGRESS)
+        {
+            ret = checkTimeouts();
+            if (ret != HTTP_SUCCESS)
+            {
+                break;
+            }
+            // We haven't got any data, so let's pause to allow some to arrive
+            waitForData(waitDelay);
+            if (available())
+            {
+                waitDelay = iWaitForDataMinDelay;
+            }
+        }
+        if (ret < 0)
+        {
+            ret = retryRequest(ret);
+        }
+    } while ((ret == HTTP_POLL_IN_PROGRESS) ||
+             (((ret == 301) || (ret == 302) || (ret == 303) || (ret == 307) || (ret == 308)) &&
+              ((ret = followRedirect(ret)) == HTTP_SUCCESS)));
+    return ret;
+}
+
+int HttpClient::followRedirect(int aStatus)
+{
+    if (iRedirectChecked || !iRedirectBuffer || !iRequestPath || (iPipelined > 0))
+    {
+        // We can't (or have already decided not to) follow this one
+        return aStatus;
+    }
+    iRedirectChecked = true;
+
+    // Even if we can't follow it, we'll get the Location for the caller
+    bool follow = (iRedirectCount < iMaxRedirects);
+    const char* method = iRequestMethod;
+    if (((aStatus == 303) && (strcmp(method, HTTP_METHOD_HEAD) != 0)) ||
+        (((aStatus == 301) || (aStatus == 302)) && (strcmp(method, HTTP_METHOD_POST) == 0)))
+    {
+        // The new URL is to be fetched, whatever the request was
+        method = HTTP_METHOD_GET;
+    }
+    else if (iRequestHadBody)
+    {
+        // The body would have to be sent again, and we haven't got it
+        follow = false;
+    }
+
+    // Keep the server name and path of this request at the start of the
+    // buffer, where the next one will be worked out, with the Location
+    // after them
+    size_t serverNameLength = strlen(iRequestServerName) + 1;
+    size_t pathLength = strlen(iRequestPath) + 1;
+    if (serverNameLength + pathLength + 2 > iRedirectBufferSize)
+    {
+        return aStatus;
+    }
+    if (iRequestServerName != iRedirectBuffer)
+    {
+        memcpy(iRedirectBuffer, iRequestServerName, serverNameLength);
+        memcpy(iRedirectBuffer + serverNameLength, iRequestPath, pathLength);
+        iRequestServerName = iRedirectBuffer;
+        iRequestPath = iRedirectBuffer + serverNameLength;
+    }
+    iLocationStart = serverNameLength + pathLength;
+    iCapturingLocation = true;
+    startHeaderLine();
+    int ret = skipResponseHeaders();
+    iCapturingLocation = false;
+    if (ret != HTTP_SUCCESS)
+    {
+        return ret;
+    }
+    if (!follow || !iLocationFound || !resolveLocation())
+    {
+        // The caller will have to decide what to do about it
+        return aStatus;
+    }
+
+    // Throw away the body, so the connection can be used again
+    if (iKeepAlive)
+    {
+        (void)skipBody();
+    }
+    endPreviousResponse();
+    uint8_t redirectCount = iRedirectCount + 1;
+    unsigned long requestStartTime = iRequestStartTime;
+    ret = startRequest(iRequestServerName, iRequestServerPort, iRequestPath, method, iRequestUserAgent);
+    // It's still the same request as far as the caller is concerned
+    iRedirectCount = redirectCount;
+    iRequestStartTime = requestStartTime;
+    return ret;
+}
+
+int HttpClient::retryRequest(int aError)
+{
+    // A kept-alive connection can be closed by the server while it's idle,
+    // and we only find out when we use it.  If that's what happened, and
+    // nothing of the response has arrived, make the request again (once)
+    // on a new connection.  We can only do that if we know all of what was
+    // sent, and it's safe to send twice
+    if (!iRequestReusedConnection || !iRequestPath || iRequestHadBody ||
+        iRequestHadHeaders || (iPipelined > 0) ||
+        (iState != eRequestSent) || (iStatusPtr != kStatusPrefix) ||
+        (strcmp(iRequestMethod, HTTP_METHOD_POST) == 0) ||
+        ((aError != HTTP_ERROR_CONNECTION_CLOSED) && (aError != HTTP_ERROR_TIMED_OUT) &&
+         (aError != HTTP_ERROR_FIRST_BYTE_TIMED_OUT)))
+    {
+        return aError;
+    }
+#ifdef LOGGING
+    Serial.println("Kept-alive connection failed, retrying");
+#endif
+    closeConnection();
+    resetState();
+    uint8_t redirectCount = iRedirectCount;
+    unsigned long requestStartTime = iRequestStartTime;
+    // The new connection isn't a reused one, so this won't be tried again
+    int ret = startRequest(iRequestServerName, iRequestServerPort, iRequestPath, iRequestMethod, iRequestUserAgent);
+    iRedirectCount = redirectCount;
+    iRequestStartTime = requestStartTime;
+    return (ret == HTTP_SUCCESS) ? HTTP_POLL_IN_PROGRESS : ret;
+}
+
+bool HttpClient::resolveLocation()
+{
+    char* location = iRedirectBuffer + iLocationStart;
+    // The fragment is only for the client
+    char* fragment = strchr(location, '#');
+    if (fragment)
+    {
+        *fragment = '\0';
+    }
+    size_t length = strlen(location);
+    size_t serverNameLength = strlen(iRedirectBuffer) + 1;
+
+    const char* server = NULL;
+    if (strncasecmp(location, "http://", 7) == 0)
+    {
+        server = location + 7;
+    }
+    else if ((location[0] == '/') && (location[1] == '/'))
+    {
+        // Same scheme, different server
+        server = location + 2;
+    }
+    else
+    {
+        // If there's a scheme it isn't one we can follow
+        size_t schemeEnd = strcspn(location, ":/?");
+        if (location[schemeEnd] == ':')
+        {
+            return false;
+        }
+    }
+
+    if (server)
+    {
+        // An absolute URL, so the server, port and path all come from it
+        size_t nameLength = strcspn(server, ":/?");
+        if (nameLength == 0)
+        {
+            return false;
+        }
+        const char* path = server + nameLength;
+        uint16_t port = kHttpPort;
+        if (*path == ':')
+        {
+            port = 0;
+            while (isdigit(*++path))
+            {
+                port = port*10 + (*path - '0');
+            }
+        }
+        iRequestServerPort = port;
+        memmove(iRedirectBuffer, server, nameLength);
+        iRedirectBuffer[nameLength] = '\0';
+        char* newPath = iRedirectBuffer + nameLength + 1;
+        if (*path != '/')
+        {
+            // It's just the server (and maybe a query), so it's the root
+            *newPath++ = '/';
+        }
+        memmove(newPath, path, strlen(path) + 1);
+        iRequestServerName = iRedirectBuffer;
+        iRequestPath = iRedirectBuffer + nameLength + 1;
+        return true;
+    }
+
+    // It's relative to the current URL, so goes after whatever part of the
+    // current path it replaces.  Any "." or ".." segments are left for the
+    // server to deal with
+    char* path = iRedirectBuffer + serverNameLength;
+    size_t keep = 0;
+    if (location[0] == '?')
+    {
+        // Just the query changes
+        keep = strcspn(path, "?");
+    }
+    else if (location[0] != '/')
+    {
+        // Replace everything after the last '/' of the path
+        size_t pathEnd = strcspn(path, "?");
+        for (size_t i = 0; i < pathEnd; i++)
+        {
+            if (path[i] == '/')
+            {
+                keep = i + 1;
+            }
+        }
+    }
+    memmove(path + keep, location, length + 1);
+    iRequestPath = path;
+    return true;
+}
+
+int HttpClient::readStatusLine()
+{
+    if (iState >= eStatusCodeRead)
+    {
+        // We've already got it
+        return iStatusCode;
+    }
+
+    // The first line will be of the form Status-Line:
+    //   HTTP-Version SP Status-Code SP Reason-Phrase CRLF
+    // Where HTTP-Version is of the form:
+    //   HTTP-Version   = "HTTP" "/" 1*DIGIT "." 1*DIGIT
+    int c;
+    while ((iState < eStatusCodeRead) && ((c = clientRead()) >= 0))
+    {
+        // We read something, reset the timeout counter
+        iLastReadTime = millis();
+        switch(iState)
+        {
+        case eRequestSent:
+            // We haven't reached the status code yet
+            if ((iStatusPtr == kStatusPrefix) && ((c == '\r') || (c == '\n')))
+            {
+                // Skip any blank lines before the status line, such as the
+                // one ending a 100 Continue response
+                break;
+            }
+            if ( (*iStatusPtr == '*') || (*iStatusPtr == c) )
+            {
+                if (*iStatusPtr == '*')
+                {
+                    // This is part of the HTTP version.  We keep it in
+                    // iStatusCode until we reach the status code itself
+                    iStatusCode = iStatusCode*10 + (c - '0');
+                }
+                // This character matches, just move along
+                iStatusPtr++;
+                if (*iStatusPtr == '\0')
+                {
+                    // We've reached the end of the prefix
+                    iState = eReadingStatusCode;
+                    if (iStatusCode < 11)
+                    {
+                        // HTTP/1.0 servers close the connection after each
+                        // response
+                        iServerWillClose = true;
+                    }
+                    iStatusCode = 0;
+                }
+            }
+            else
+            {
+                return HTTP_ERROR_INVALID_RESPONSE;
+            }
+            break;
+        case eReadingStatusCode:
+            if (isdigit(c))
+            {
+                // This assumes we won't get more than the 3 digits we
+                // want
+                iStatusCode = iStatusCode*10 + (c - '0');
+            }
+            else
+            {
+                // We've reached the end of the status code
+                // We could sanity check it here or double-check for ' '
+                // rather than anything else, but let's be lenient
+                iState = eSkipToEndOfStatusLine;
+            }
+            break;
+        default:
+            // We're just waiting for the end of the line now
+            break;
+        };
+
+        if ((c == '\n') && (iState > eRequestSent))
+        {
+            if (iStatusCode < 200)
+            {
+                // We've reached the end of an informational status line.
+                // We just ignore those really (apart from noting the go
+                // ahead for the body), and read the next line for a proper
+                // response
+                if (iStatusCode == 100)
+                {
+                    iContinueReceived = true;
+                }
+                iState = eRequestSent;
+                iStatusPtr = kStatusPrefix;
+                iStatusCode = 0;
+            }
+            else
+            {
+                // We've read the status-line successfully, so the headers
+                // are next
+                iState = eStatusCodeRead;
+                startHeaderLine();
+                metricsStatusRead();
+            }
+        }
+    }
+
+    if ((iState < eStatusCodeRead) && serverClosed())
+    {
+        // It isn't going to arrive now
+        return HTTP_ERROR_CONNECTION_CLOSED;
+    }
+    return (iState == eStatusCodeRead) ? iStatusCode : HTTP_POLL_IN_PROGRESS;
+}
+
+void HttpClient::waitForData(uint32_t& aWaitDelay)
+{
+    if (iWaitForDataCallback)
+    {
+        // Let the user's code decide how best to wait
+        iWaitForDataCallback(*iClient, aWaitDelay);
+    }
+    else
+    {
+        delay(aWaitDelay);
+    }
+    // The longer we've been waiting the less likely it is that data is about
+    // to turn up, so back off until we hit the maximum delay
+    aWaitDelay *= 2;
+    if (aWaitDelay > iWaitForDataMaxDelay)
+    {
+        aWaitDelay = iWaitForDataMaxDelay;
+    }
+}
+
+int HttpClient::skipResponseHeaders()
+{
+    // Just keep reading until we finish reading the headers or time out
+    iLastReadTime = millis();
+    uint32_t waitDelay = iWaitForDataMinDelay;
+    // Whilst we haven't timed out & haven't reached the end of the headers
+    int timedOut = HTTP_SUCCESS;
+    while (!endOfHeadersReached())
+    {
+        if (readHeaders())
+        {
+            waitDelay = iWaitForDataMinDelay;
+        }
+        else if (serverClosed())
+        {
+            // The rest of the headers aren't going to arrive
+            return HTTP_ERROR_CONNECTION_CLOSED;
+        }
+        else if ((timedOut = checkTimeouts()) != HTTP_SUCCESS)
+        {
+            // We must've timed out
+            return timedOut;
+        }
+        else
+        {
+            // We haven't got any data, so let's pause to allow some to
+            // arrive
+            waitForData(waitDelay);
+        }
+    }
+    // Success
+    return HTTP_SUCCESS;
+}
+
+bool HttpClient::readHeaders()
+{
+    if ((iRxStart == iRxEnd) && !fillReceiveBuffer())
+    {
+        return false;
+    }
+    // Work through whatever has arrived, a block at a time
+    do
+    {
+        if (iState == eSkipToEndOfHeader)
+        {
+            // Nothing else in this line interests us, so jump straight to
+            // the end of it
+            skipToEndOfLine();
+        }
+        if (iRxStart < iRxEnd)
+        {
+            (void)readHeader();
+        }
+    } while (!endOfHeadersReached() && ((iRxStart < iRxEnd) || fillReceiveBuffer()));
+    // We read something, reset the timeout counter
+    iLastReadTime = millis();
+    return true;
+}
+
+int HttpClient::poll()
+{
+    if (iState < eRequestSent)
+    {
+        return HTTP_ERROR_API;
+    }
+    if (iState < eStatusCodeRead)
+    {
+        int ret = readStatusLine();
+        if (ret < 0)
+        {
+            return retryRequest(ret);
+        }
+    }
+    if ((iState >= eStatusCodeRead) && !endOfHeadersReached())
+    {
+        (void)readHeaders();
+    }
+
+    if (!endOfHeadersReached())
+    {
+        if (serverClosed())
+        {
+            // The rest of the headers aren't going to arrive
+            return HTTP_ERROR_CONNECTION_CLOSED;
+        }
+        int timedOut = checkTimeouts();
+        return (timedOut != HTTP_SUCCESS) ? retryRequest(timedOut) : HTTP_POLL_IN_PROGRESS;
+    }
+    if (iDecoding && (iDecoder->error() != HTTP_SUCCESS))
+    {
+        return iDecoder->error();
+    }
+    if (endOfBodyReached())
+    {
+        metricsFinish();
+        return HTTP_POLL_COMPLETE;
+    }
+    if (!iDecoding && serverClosed())
+    {
+        // The server has closed the connection and we've had everything it
+        // sent.  That's only the end of the body if we didn't know where
+        // the end would be (if we're decoding the body, the decoder will
+        // tell us whether it got all of it)
+        if (iIsChunked || (iContentLength != kNoContentLengthHeader))
+        {
+            return HTTP_ERROR_CONNECTION_CLOSED;
+        }
+        metricsFinish();
+        return HTTP_POLL_COMPLETE;
+    }
+    if (clientAvailable() == 0)
+    {
+        // Nothing is waiting to be read, so the body has stalled
+        int timedOut = checkTimeouts();
+        if (timedOut != HTTP_SUCCESS)
+        {
+            return timedOut;
+        }
+    }
+    return HTTP_POLL_READING_BODY;
+}
+
+bool HttpClient::endOfBodyReached()
+{
+    if (iDecoding)
+    {
+        // It's the end of the decoded body that matters
+        return iDecoder->finished() && (iDecodedPeek < 0);
+    }
+    return endOfRawBodyReached();
+}
+
+bool HttpClient::endOfRawBodyReached()
+{
+    bool ret = false;
+    if (endOfHeadersReached() &&
+        ((iStatusCode == 204) || (iStatusCode == 304) || (iHeadRequests & 1)))
+    {
+        // These responses never have a body
+        ret = true;
+    }
+    else if (endOfHeadersReached() && iIsChunked)
+    {
+        // Move past any framing that's waiting, in case it's the last chunk
+        (void)readChunkFraming();
+        ret = (iChunkState == eChunkBodyEnd);
+    }
+    else if (endOfHeadersReached() && (contentLength() != kNoContentLengthHeader))
+    {
+        // We've got to the body and we know how long it will be
+        ret = (iBodyLengthConsumed >= contentLength());
+    }
+    if (ret)
+    {
+        metricsFinish();
+    }
+    return ret;
+}
+
+int HttpClient::read()
+{
+    if (iDecoding)
+    {
+        uint8_t b;
+        return (readDecoded(&b, 1) == 1) ? b : -1;
+    }
+#if 0 // Fails on WiFi because multi-byte read seems to be broken
+    uint8_t b[1];
+    int ret = read(b, 1);
+    if (ret == 1)
+    {
+        return b[0];
+    }
+    else
+    {
+        return -1;
+    }
+#else
+    if (endOfHeadersReached() && iIsChunked)
+    {
+        if (!readChunkFraming())
+        {
+            // Either there's no data yet or we're at the end of the body
+            return -1;
+        }
+        int ret = clientRead();
+        if (ret >= 0)
+        {
+            iBodyLengthConsumed++;
+            if (--iChunkLength == 0)
+            {
+                iChunkState = eChunkDataEnd;
+            }
+        }
+        return ret;
+    }
+    if (endOfHeadersReached() && endOfRawBodyReached())
+    {
+        // Anything else on the connection is part of the next response
+        return -1;
+    }
+
+    int ret = clientRead();
+    if ((ret >= 0) && endOfHeadersReached())
+    {
+        // We're outputting the body now, so keep track of how much of it
+        // has been read (and so, if we know its length, how much is left)
+        iBodyLengthConsumed++;
+    }
+    return ret;
+#endif
+}
+
+int HttpClient::read(uint8_t *buf, size_t size)
+{
+    if (iDecoding)
+    {
+        return readDecoded(buf, size);
+    }
+    return readRawBody(buf, size);
+}
+
+int HttpClient::readRawBody(uint8_t *buf, size_t size)
+{
+    if (endOfHeadersReached() && iIsChunked)
+    {
+        return readChunked(buf, size);
+    }
+    if (endOfHeadersReached())
+    {
+        if (endOfRawBodyReached())
+        {
+            // Anything else on the connection is part of the next response
+            return -1;
+        }
+        if ((iContentLength != kNoContentLengthHeader) &&
+            (size > (size_t)(iContentLength - iBodyLengthConsumed)))
+        {
+            // Don't read past the end of the body
+            size = iContentLength - iBodyLengthConsumed;
+        }
+    }
+
+    int ret =clientRead(buf, size);
+    if ((ret > 0) && endOfHeadersReached())
+    {
+        // We're outputting the body now, so keep track of how much of it
+        // has been read (and so, if we know its length, how much is left)
+        iBodyLengthConsumed += ret;
+    }
+    return ret;
+}
+
+int HttpClient::readDecoded(uint8_t *buf, size_t size)
+{
+    size_t ret = 0;
+    if ((iDecodedPeek >= 0) && (size > 0))
+    {
+        // Start with the byte that peek() decoded
+        buf[ret++] = iDecodedPeek;
+        iDecodedPeek = -1;
+    }
+    while ((ret < size) && !iDecoder->finished())
+    {
+        int decoded = iDecoder->decode(buf + ret, size - ret);
+        if (decoded > 0)
+        {
+            ret += decoded;
+        }
+        else if (decoded == 0)
+        {
+            // It needs more of the body, so give it whatever has arrived
+            size_t space;
+            uint8_t* input = iDecoder->inputBuffer(space);
+            int len = (space > 0) ? readRawBody(input, space) : -1;
+            if (len > 0)
+            {
+                iDecoder->inputAdded(len);
+            }
+            else
+            {
+                if (endOfRawBodyReached() || serverClosed())
+                {
+                    // That's all of it, so the decoder should have finished
+                    iDecoder->endOfInput();
+                }
+                break;
+            }
+        }
+        // else decoding failed, and finished() will now say so
+    }
+    return (ret > 0) ? (int)ret : -1;
+}
+
+int HttpClient::available()
+{
+    if (iDecoding)
+    {
+        // We can't tell how much the body will decode to, but we can see if
+        // there's at least one byte
+        if (iDecodedPeek < 0)
+        {
+            uint8_t b;
+            if (readDecoded(&b, 1) == 1)
+            {
+                iDecodedPeek = b;
+            }
+        }
+        return (iDecodedPeek >= 0) ? 1 : 0;
+    }
+    if (endOfHeadersReached() && iIsChunked)
+    {
+        // Only count the bytes in the chunk we're reading, not the framing
+        if (!readChunkFraming())
+        {
+            return 0;
+        }
+        unsigned long ret = clientAvailable();
+        return (ret > iChunkLength) ? iChunkLength : ret;
+    }
+    if (endOfHeadersReached())
+    {
+        if (endOfRawBodyReached())
+        {
+            // Anything else on the connection is part of the next response
+            return 0;
+        }
+        if (iContentLength != kNoContentLengthHeader)
+        {
+            long ret = clientAvailable();
+            return (ret > iContentLength - iBodyLengthConsumed) ? (iContentLength - iBodyLengthConsumed) : ret;
+        }
+    }
+    return clientAvailable();
+}
+
+int HttpClient::peek()
+{
+    if (iDecoding)
+    {
+        (void)available();
+        return iDecodedPeek;
+    }
+    if (endOfHeadersReached() && iIsChunked && !readChunkFraming())
+    {
+        return -1;
+    }
+    if (endOfHeadersReached() && !iIsChunked && endOfRawBodyReached())
+    {
+        return -1;
+    }
+    return clientPeek();
+}
+
+int HttpClient::readBody(uint8_t* aBuffer, size_t aSize)
+{
+    if (!endOfHeadersReached())
+    {
+        return HTTP_ERROR_API;
+    }
+    iLastReadTime = millis();
+    uint32_t waitDelay = iWaitForDataMinDelay;
+    while (!endOfBodyReached())
+    {
+        int ret = read(aBuffer, aSize);
+        if (ret > 0)
+        {
+            iLastReadTime = millis();
+            return ret;
+        }
+        if (!iDecoding && serverClosed())
+        {
+            // That's all there is.  If we knew how long the body should be,
+            // we didn't get all of it
+            return (iIsChunked || (iContentLength != kNoContentLengthHeader)) ? HTTP_ERROR_CONNECTION_CLOSED : 0;
+        }
+        int timedOut = checkTimeouts();
+        if (timedOut != HTTP_SUCCESS)
+        {
+            return timedOut;
+        }
+        waitForData(waitDelay);
+    }
+    // A decoder finishes when it fails, as well as at the end
+    return iDecoding ? iDecoder->error() : 0;
+}
+
+int HttpClient::skipBody()
+{
+    if (!endOfHeadersReached())
+    {
+        return HTTP_ERROR_API;
+    }
+
+    // Throw the body away a block at a time, until we get to the end of it
+    // (or, if we don't know where that is, until the server closes the
+    // connection)
+    // There's no need to decode any of it
+    iDecoding = false;
+    iDecodedPeek = -1;
+    uint8_t buf[kSkipBodyBlockSize];
+    iLastReadTime = millis();
+    uint32_t waitDelay = iWaitForDataMinDelay;
+    while (!endOfRawBodyReached())
+    {
+        int timedOut = HTTP_SUCCESS;
+        if (readRawBody(buf, sizeof(buf)) > 0)
+        {
+            iLastReadTime = millis();
+            waitDelay = iWaitForDataMinDelay;
+        }
+        else if (serverClosed())
+        {
+            // That's all there is.  If we knew how long the body should be,
+            // we didn't get all of it
+            return (iIsChunked || (iContentLength != kNoContentLengthHeader)) ? HTTP_ERROR_CONNECTION_CLOSED : HTTP_SUCCESS;
+        }
+        else if ((timedOut = checkTimeouts()) != HTTP_SUCCESS)
+        {
+            return timedOut;
+        }
+        else
+        {
+            waitForData(waitDelay);
+        }
+    }
+    return HTTP_SUCCESS;
+}
+
+bool HttpClient::readChunkFraming()
+{
+    // Chunked bodies look like this (RFC 7230, section 4.1):
+    //   chunk-size [ ";" chunk-ext ] CRLF chunk-data CRLF
+    //   ... more chunks ...
+    //   "0" [ ";" chunk-ext ] CRLF *( trailer-field CRLF ) CRLF
+    // We're lenient and treat a bare '\n' as the end of a line too
+    while ((iChunkState != eChunkData) && (iChunkState != eChunkBodyEnd))
+    {
+        int c = clientRead();
+        if (c < 0)
+        {
+            // Nothing more to read yet
+            return false;
+        }
+        switch(iChunkState)
+        {
+        case eChunkSize:
+            if (isxdigit(c))
+            {
+                iChunkLength = iChunkLength*16 + (isdigit(c) ? (c - '0') : (tolower(c) - 'a' + 10));
+            }
+            else if (c == '\n')
+            {
+                iChunkState = (iChunkLength > 0) ? eChunkData : eChunkTrailerStart;
+            }
+            else
+            {
+                // Either the '\r' at the end of the line, or the start of
+                // a chunk extension, which we ignore
+                iChunkState = eChunkExtension;
+            }
+            break;
+        case eChunkExtension:
+            if (c == '\n')
+            {
+                iChunkState = (iChunkLength > 0) ? eChunkData : eChunkTrailerStart;
+            }
+            break;
+        case eChunkDataEnd:
+            // Waiting for the CRLF after the chunk data
+            if (c == '\n')
+            {
+                iChunkState = eChunkSize;
+                iChunkLength = 0;
+            }
+            break;
+        case eChunkTrailerStart:
+            if (c == '\n')
+            {
+                // Blank line, so that's the end of the body
+                iChunkState = eChunkBodyEnd;
+            }
+            else if (c != '\r')
+            {
+                // A trailer header, which we ignore
+                iChunkState = eChunkTrailer;
+            }
+            break;
+        case eChunkTrailer:
+            if (c == '\n')
+            {
+                iChunkState = eChunkTrailerStart;
+            }
+            break;
+        default:
+            break;
+        };
+    }
+    return (iChunkState == eChunkData);
+}
+
+int HttpClient::readChunked(uint8_t *buf, size_t size)
+{
+    size_t total = 0;
+    // Read as much as we can of as many chunks as we can, so the caller
+    // gets the body in bulk rather than a chunk at a time
+    while ((total < size) && readChunkFraming())
+    {
+        size_t toRead = size - total;
+        if (toRead > iChunkLength)
+        {
+            toRead = iChunkLength;
+        }
+        int ret = clientRead(buf+total, toRead);
+        if (ret <= 0)
+        {
+            break;
+        }
+        total += ret;
+        iBodyLengthConsumed += ret;
+        iChunkLength -= ret;
+        if (iChunkLength == 0)
+        {
+            iChunkState = eChunkDataEnd;
+        }
+    }
+    return (total > 0) ? (int)total : -1;
+}
+
+bool HttpClient::fillReceiveBuffer()
+{
+    // Only ask for what's there, as some Clients don't cope with being asked
+    // for more than they have
+    int avail = iClient->available();
+    if (avail <= 0)
+    {
+        return false;
+    }
+    int ret = iClient->read(iRxBuffer, ((size_t)avail < sizeof(iRxBuffer)) ? avail : sizeof(iRxBuffer));
+    metricsReceived(ret);
+    if (ret > 0)
+    {
+        iLastReadTime = millis();
+        iResponseStarted = true;
+    }
+    if (ret <= 0)
+    {
+        return false;
+    }
+    iRxStart = 0;
+    iRxEnd = ret;
+    return true;
+}
+
+int HttpClient::clientAvailable()
+{
+    return (iRxEnd - iRxStart) + iClient->available();
+}
+
+int HttpClient::clientRead()
+{
+    if ((iRxStart == iRxEnd) && !fillReceiveBuffer())
+    {
+        return -1;
+    }
+    return iRxBuffer[iRxStart++];
+}
+
+int HttpClient::clientRead(uint8_t *buf, size_t size)
+{
+    if (iRxStart == iRxEnd)
+    {
+        // Nothing buffered, so save a copy and read straight into buf
+        int ret = iClient->read(buf, size);
+        metricsReceived(ret);
+        if (ret > 0)
+        {
+            iLastReadTime = millis();
+            iResponseStarted = true;
+        }
+        return ret;
+    }
+    size_t ret = iRxEnd - iRxStart;
+    if (ret > size)
+    {
+        ret = size;
+    }
+    memcpy(buf, iRxBuffer+iRxStart, ret);
+    iRxStart += ret;
+    return ret;
+}
+
+int HttpClient::clientPeek()
+{
+    if (iRxStart < iRxEnd)
+    {
+        return iRxBuffer[iRxStart];
+    }
+    return iClient->peek();
+}
+
+void HttpClient::skipToEndOfLine()
+{
+    // Leave the '\n' itself in the buffer for readHeader() to deal with
+    const uint8_t* eol = (const uint8_t*)memchr(iRxBuffer+iRxStart, '\n', iRxEnd-iRxStart);
+    iRxStart = eol ? (eol - iRxBuffer) : iRxEnd;
+}
+
+int HttpClient::readHeader()
+{
+    char c = read();
+
+    if (endOfHeadersReached())
+    {
+        // We've passed the headers, but rather than return an error, we'll just
+        // act as a slightly less efficient version of read()
+        return c;
+    }
+
+    // Whilst reading out the headers to whoever wants them, we'll keep an
+    // eye out for the headers we need (Content-Length, etc.) and any the
+    // user has asked us to capture
+    switch(iState)
+    {
+    case eStatusCodeRead:
+        // We're at the start of a line, or somewhere in the middle of reading
+        // the name of a header
+        if ((iHeaderNamePos == 0) && (c == '\r'))
+        {
+            // We've found a '\r' at the start of a line, so this is probably
+            // the end of the headers
+            iState = eLineStartingCRFound;
+        }
+        else if (c == ':')
+        {
+            // End of the header name, see if it's one we want
+            startHeaderValue();
         }
         else
         {
-            // This isn't the Content-Length header, skip to the end of the line
-            iState = eSkipToEndOfHeader;
+            matchHeaderName(c);
         }
         break;
-    case eReadingContentLength:
-        if (isdigit(c))
+    case eReadingHeaderValue:
+        if ((c == '\r') || (c == '\n'))
         {
-            iContentLength = iContentLength*10 + (c - '0');
+            endHeaderValue();
         }
-        else
+        else if (iHeaderValueStarted || ((c != ' ') && (c != '\t')))
         {
-            // We've reached the end of the content length
-            // We could sanity check it here or double-check for "\r\n"
-            // rather than anything else, but let's be lenient
-            iState = eSkipToEndOfHeader;
+            // Leading whitespace isn't part of the value
+            iHeaderValueStarted = true;
+            readHeaderValue(c);
         }
         break;
     case eLineStartingCRFound:
         if (c == '\n')
         {
             iState = eReadingBody;
+            metricsHeadersRead();
+            if (iIsChunked)
+            {
+                // Any Content-Length must be ignored when the body is chunked
+                iContentLength = kNoContentLengthHeader;
+            }
+            if (iDecoder && (iContentEncoding != kNoContentEncoding) && !endOfRawBodyReached())
+            {
+                // We can decode the body, so read() will return it decoded
+                iDecoding = true;
+                iDecoder->begin((HttpContentDecoder::tEncoding)iContentEncoding);
+            }
         }
         break;
     default:
@@ -555,11 +1996,378 @@ int HttpClient::readHeader()
     {
         // We've got to the end of this line, start processing again
         iState = eStatusCodeRead;
-        iContentLengthPtr = kContentLengthPrefix;
+        startHeaderLine();
     }
     // And return the character read to whoever wants it
     return c;
 }
 
+void HttpClient::startHeaderLine()
+{
+    iHeaderNamePos = 0;
+    iHeaderMatch = (1 << kNumHeaders) - 1;
+    if (!iCapturingLocation)
+    {
+        // Only redirects we're following need their Location
+        iHeaderMatch &= ~(1 << eLocationHeader);
+    }
+    iCaptureMatch = (1 << iCaptureCount) - 1;
+}
+
+void HttpClient::matchHeaderName(char c)
+{
+    // Header names are case-insensitive, so match them that way
+    c = tolower(c);
+    for (uint8_t i = 0; i < kNumHeaders; i++)
+    {
+        if ((iHeaderMatch & (1 << i)) && (tolower(kHeaderNames[i][iHeaderNamePos]) != c))
+        {
+            iHeaderMatch &= ~(1 << i);
+        }
+    }
+    for (uint8_t i = 0; i < iCaptureCount; i++)
+    {
+        if ((iCaptureMatch & (1 << i)) && (tolower(iCaptureNames[i][iHeaderNamePos]) != c))
+        {
+            iCaptureMatch &= ~(1 << i);
+        }
+    }
+    iHeaderNamePos++;
+
+    if ((iHeaderMatch == 0) && (iCaptureMatch == 0))
+    {
+        // This isn't a header we're interested in, skip to the end of the line
+        iState = eSkipToEndOfHeader;
+    }
+}
+
+void HttpClient::startHeaderValue()
+{
+    // Work out which header, if any, this is.  We only need to check the
+    // names that have matched so far are the same length
+    iHeaderId = kNumHeaders;
+    for (uint8_t i = 0; i < kNumHeaders; i++)
+    {
+        if ((iHeaderMatch & (1 << i)) && (kHeaderNames[i][iHeaderNamePos] == '\0'))
+        {
+            iHeaderId = i;
+        }
+    }
+    iCaptureId = kNoCapture;
+    for (uint8_t i = 0; i < iCaptureCount; i++)
+    {
+        if ((iCaptureMatch & (1 << i)) && (iCaptureNames[i][iHeaderNamePos] == '\0') &&
+            (iCapturedOffset[i] == kNoCapture))
+        {
+            // We keep the first value if the header is repeated
+            iCaptureId = i;
+        }
+    }
+
+    if ((iHeaderId == kNumHeaders) && (iCaptureId == kNoCapture))
+    {
+        iState = eSkipToEndOfHeader;
+        return;
+    }
+    iState = eReadingHeaderValue;
+    iHeaderValueStarted = false;
+    iCaptureLength = 0;
+    switch (iHeaderId)
+    {
+    case eContentLengthHeader:
+        // Just in case we get multiple Content-Length headers, this
+        // will ensure we just get the value of the last one
+        iContentLength = 0;
+        break;
+    case eConnectionHeader:
+        iHeaderValuePtr = kHeaderValueClose;
+        iHeaderTokenCount = 0;
+        break;
+    case eTransferEncodingHeader:
+        iHeaderValuePtr = kHeaderValueChunked;
+        iHeaderTokenCount = 0;
+        break;
+    case eContentEncodingHeader:
+        iHeaderValuePtr = kHeaderValueGzip;
+        iHeaderTokenCount = 0;
+        iContentEncoding = kNoContentEncoding;
+        break;
+    case eContentRangeHeader:
+        // We'll read the first byte position, then the last one (which we
+        // don't need), then the complete length
+        iRangeField = 0;
+        iRangeStart = 0;
+        iRangeTotal = kNoContentLengthHeader;
+        break;
+    case eLocationHeader:
+        iLocationLength = 0;
+        break;
+    default:
+        break;
+    };
+}
+
+void HttpClient::readHeaderValue(char c)
+{
+    if (iHeaderId == eContentLengthHeader)
+    {
+        if (isdigit(c))
+        {
+            iContentLength = iContentLength*10 + (c - '0');
+        }
+        else
+        {
+            // We've reached the end of the content length
+            // We could sanity check it here or double-check for "\r\n"
+            // rather than anything else, but let's be lenient
+            iHeaderId = kNumHeaders;
+        }
+    }
+    else if (iHeaderId == eContentRangeHeader)
+    {
+        // This is of the form "bytes 200-999/1000", although the complete
+        // length can be "*" if the server doesn't know it, and a 416
+        // response just has "bytes */1000"
+        if (c == '-')
+        {
+            iRangeField = 1;
+        }
+        else if (c == '/')
+        {
+            iRangeField = 2;
+        }
+        else if (isdigit(c) && (iRangeField == 0))
+        {
+            iRangeStart = iRangeStart*10 + (c - '0');
+        }
+        else if (isdigit(c) && (iRangeField == 2))
+        {
+            iRangeTotal = ((iRangeTotal == kNoContentLengthHeader) ? 0 : iRangeTotal*10) + (c - '0');
+        }
+    }
+    else if (iHeaderId == eLocationHeader)
+    {
+        // Keep room for the terminating '\0'
+        if (iLocationStart + iLocationLength + 1 < iRedirectBufferSize)
+        {
+            iRedirectBuffer[iLocationStart + iLocationLength] = c;
+        }
+        // Count it even if it doesn't fit, so we know it didn't
+        iLocationLength++;
+    }
+    else if (c == ',')
+    {
+        if (iHeaderId != kNumHeaders)
+        {
+            endHeaderToken();
+        }
+    }
+    else if ((iHeaderId != kNumHeaders) && (c != ' ') && (c != '\t'))
+    {
+        // See if this token of the list is the one we're after.  Tokens
+        // aren't case sensitive, but any captured value is kept as it was
+        // sent
+        char lower = tolower(c);
+        if ((iHeaderValuePtr == kHeaderValueGzip) && (lower == *kHeaderValueDeflate))
+        {
+            // Either of the encodings we can decode will do
+            iHeaderValuePtr = kHeaderValueDeflate;
+        }
+        else if ((iHeaderValuePtr == kHeaderValueGzip) && (lower == *kHeaderValueXGzip))
+        {
+            // As will the old name for gzip
+            iHeaderValuePtr = kHeaderValueXGzip;
+        }
+        if (iHeaderValuePtr && (*iHeaderValuePtr == lower))
+        {
+            iHeaderValuePtr++;
+        }
+        else
+        {
+            iHeaderValuePtr = NULL;
+        }
+    }
+
+    if (iCaptureId != kNoCapture)
+    {
+        // Keep room for the terminating '\0'
+        if (iCaptureUsed + iCaptureLength + 1 < iCaptureBufferSize)
+        {
+            iCaptureBuffer[iCaptureUsed + iCaptureLength] = c;
+        }
+        // Count it even if it doesn't fit, so we know it didn't
+        iCaptureLength++;
+    }
+}
+
+void HttpClient::endHeaderToken()
+{
+    const char* token = (iHeaderId == eConnectionHeader) ? kHeaderValueClose :
+                        (iHeaderId == eTransferEncodingHeader) ? kHeaderValueChunked : kHeaderValueGzip;
+    if (iHeaderValuePtr == token)
+    {
+        // Nothing in this one, which the list is allowed
+        return;
+    }
+    bool matched = iHeaderValuePtr && (*iHeaderValuePtr == '\0');
+    iHeaderTokenCount++;
+    if (iHeaderId == eConnectionHeader)
+    {
+        if (matched)
+        {
+            // The server will close the connection after this response
+            iServerWillClose = true;
+        }
+    }
+    else if (iHeaderId == eTransferEncodingHeader)
+    {
+        // Only the last encoding says how the body is framed, and the body
+        // is sent in chunks if that's "chunked"
+        iIsChunked = matched;
+    }
+    else if (matched && (iHeaderTokenCount == 1))
+    {
+        iContentEncoding = (iHeaderValuePtr == kHeaderValueDeflate + strlen(kHeaderValueDeflate)) ?
+                           HttpContentDecoder::eDeflate : HttpContentDecoder::eGzip;
+    }
+    else
+    {
+        // It isn't an encoding we can decode, or there's more than one of
+        // them
+        iContentEncoding = kNoContentEncoding;
+    }
+    // Get ready for the next one
+    iHeaderValuePtr = token;
+}
+
+void HttpClient::endHeaderValue()
+{
+    if ((iHeaderId == eConnectionHeader) || (iHeaderId == eTransferEncodingHeader) ||
+        (iHeaderId == eContentEncodingHeader))
+    {
+        endHeaderToken();
+    }
+    else if ((iHeaderId == eLocationHeader) && (iLocationStart + iLocationLength + 1 <= iRedirectBufferSize))
+    {
+        char* location = iRedirectBuffer + iLocationStart;
+        while ((iLocationLength > 0) &&
+               ((location[iLocationLength - 1] == ' ') || (location[iLocationLength - 1] == '\t')))
+        {
+            iLocationLength--;
+        }
+        location[iLocationLength] = '\0';
+        iLocationFound = true;
+    }
+
+    if ((iCaptureId != kNoCapture) && (iCaptureUsed + iCaptureLength + 1 <= iCaptureBufferSize))
+    {
+        // Trailing whitespace isn't part of the value either
+        while ((iCaptureLength > 0) &&
+               ((iCaptureBuffer[iCaptureUsed + iCaptureLength - 1] == ' ') ||
+                (iCaptureBuffer[iCaptureUsed + iCaptureLength - 1] == '\t')))
+        {
+            iCaptureLength--;
+        }
+        iCaptureBuffer[iCaptureUsed + iCaptureLength] = '\0';
+        iCapturedOffset[iCaptureId] = iCaptureUsed;
+        iCaptureUsed += iCaptureLength + 1;
+    }
+    // else it didn't fit, so we don't keep any of it
+
+    iState = eSkipToEndOfHeader;
+}
+
+void HttpClient::captureHeaders(const char* const* aHeaderNames, uint8_t aCount, char* aBuffer, size_t aBufferSize)
+{
+    if (!aHeaderNames || !aBuffer || (aBufferSize == 0))
+    {
+        aCount = 0;
+    }
+    iCaptureNames = aHeaderNames;
+    iCaptureCount = (aCount > kMaxCapturedHeaders) ? kMaxCapturedHeaders : aCount;
+    iCaptureBuffer = aBuffer;
+    iCaptureBufferSize = aBufferSize;
+    clearCapturedHeaders();
+}
+
+void HttpClient::clearCapturedHeaders()
+{
+    for (uint8_t i = 0; i < kMaxCapturedHeaders; i++)
+    {
+        iCapturedOffset[i] = kNoCapture;
+    }
+    iCaptureUsed = 0;
+}
+
+const char* HttpClient::capturedHeader(uint8_t aIndex)
+{
+    if ((aIndex >= iCaptureCount) || (iCapturedOffset[aIndex] == kNoCapture))
+    {
+        return NULL;
+    }
+    return iCaptureBuffer + iCapturedOffset[aIndex];
+}
+
+#if HTTP_METRICS
+void HttpClient::metricsStart()
+{
+    // Anything we were timing before has been given up on
+    metricsFinish();
+    memset(&iMetrics, 0, sizeof(iMetrics));
+    iMetricsStarted = micros();
+    iMetricsConnected = iMetricsStarted;
+    iMetricsSent = iMetricsStarted;
+    iMetricsHeaders = iMetricsStarted;
+    iMetricsPending = true;
+}
+
+void HttpClient::metricsConnected(bool aReused)
+{
+    iMetricsConnected = micros();
+    iMetrics.iConnectionReused = aReused;
+    if (!aReused)
+    {
+        iMetrics.iConnectTime = iMetricsConnected - iMetricsStarted;
+    }
+}
+
+void HttpClient::metricsSent()
+{
+    iMetricsSent = micros();
+    iMetrics.iSendTime = iMetricsSent - iMetricsConnected;
+    iMetrics.iBytesSent = iRequest.bytesWritten();
+    iMetrics.iWriteCalls = iRequest.writeCount();
+}
+
+void HttpClient::metricsStatusRead()
+{
+    iMetrics.iStatusTime = micros() - iMetricsSent;
+}
 
+void HttpClient::metricsHeadersRead()
+{
+    iMetricsHeaders = micros();
+    iMetrics.iHeadersTime = iMetricsHeaders - iMetricsSent;
+}
 
+void HttpClient::metricsFinish()
+{
+    if (!iMetricsPending)
+    {
+        return;
+    }
+    // Only report each request once
+    iMetricsPending = false;
+    unsigned long now = micros();
+    if (endOfHeadersReached())
+    {
+        iMetrics.iBodyTime = now - iMetricsHeaders;
+    }
+    iMetrics.iTotalTime = now - iMetricsStarted;
+    iMetrics.iStatusCode = (iState >= eStatusCodeRead) ? iStatusCode : 0;
+    if (iMetricsCallback)
+    {
+        iMetricsCallback(*this, iMetrics, iMetricsContext);
+    }
+}
+#endif
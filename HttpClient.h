@@ -9,6 +9,45 @@
 #include <IPAddress.h>
 #include "Client.h"
 
+// Size of the buffer used to collect the request line, headers and small
+// bodies together, so they go out in as few writes to the Client (and so as
+// few packets) as possible.  sendBody() reads the body into it too, so it's
+// also the most of the body that goes in each write; set it to 1460 to fill
+// an Ethernet packet.  Define it before including HttpClient.h to change it
+#ifndef HTTP_SEND_BUFFER_SIZE
+#ifdef __AVR__
+#define HTTP_SEND_BUFFER_SIZE 64
+#else
+#define HTTP_SEND_BUFFER_SIZE 256
+#endif
+#endif
+
+// sendBody() leaves room for four hex digits of chunk size
+#if (HTTP_SEND_BUFFER_SIZE < 16) || (HTTP_SEND_BUFFER_SIZE > 65535)
+#error HTTP_SEND_BUFFER_SIZE must be between 16 and 65535
+#endif
+
+// Longest server name that HttpClient remembers for a kept-alive
+// connection, so that it's only reused for requests to the same server.
+// Connections to servers with longer names aren't reused
+#ifndef HTTP_SERVER_NAME_LENGTH
+#ifdef __AVR__
+#define HTTP_SERVER_NAME_LENGTH 31
+#else
+#define HTTP_SERVER_NAME_LENGTH 63
+#endif
+#endif
+
+// Size of the buffer that the response is read into, so that we can pull
+// data from the Client in blocks rather than a byte at a time
+#ifndef HTTP_RECEIVE_BUFFER_SIZE
+#ifdef __AVR__
+#define HTTP_RECEIVE_BUFFER_SIZE 64
+#else
+#define HTTP_RECEIVE_BUFFER_SIZE 256
+#endif
+#endif
+
 static const int HTTP_SUCCESS =0;
 // The end of the headers has been reached.  This consumes the '\n'
 // Could not connect to the server
@@ -22,22 +61,293 @@ static const int HTTP_ERROR_TIMED_OUT =-3;
 // The response from the server is invalid, is it definitely an HTTP
 // server?
 static const int HTTP_ERROR_INVALID_RESPONSE =-4;
+// An HttpScheduler already has as many requests queued as it can hold
+static const int HTTP_ERROR_SCHEDULER_FULL =-5;
+// The server closed the connection before responding to all of the
+// requests sent on it
+static const int HTTP_ERROR_CONNECTION_CLOSED =-6;
+// The response body couldn't be decoded (see setContentDecoder())
+static const int HTTP_ERROR_DECODING_FAILED =-7;
+// Connecting to the server took longer than setConnectTimeout() allows
+static const int HTTP_ERROR_CONNECT_TIMED_OUT =-8;
+// The server didn't start its response within setFirstByteTimeout() of
+// the request being sent
+static const int HTTP_ERROR_FIRST_BYTE_TIMED_OUT =-9;
+// The request took longer altogether than setRequestDeadline() allows
+static const int HTTP_ERROR_DEADLINE_EXCEEDED =-10;
+// The address of the server couldn't be looked up (see setResolver())
+static const int HTTP_ERROR_DNS_FAILED =-11;
+// The HttpBodySource given to sendBody() ran out before the length it said
+// the body would be
+static const int HTTP_ERROR_BODY_TOO_SHORT =-12;
+
+// Values returned by poll() while a request is going well
+// Still waiting for the status line and headers of the response
+static const int HTTP_POLL_IN_PROGRESS =1;
+// The status line and headers have been read, and the body can be read
+// as it arrives
+static const int HTTP_POLL_READING_BODY =2;
+// The whole response has been received
+static const int HTTP_POLL_COMPLETE =3;
+
+// Set HTTP_METRICS to 1 to have HttpClient time each request and count the
+// bytes and Client calls it takes (see HttpMetrics), or to 0 to leave all of
+// that out.  It's left out by default on AVR, to save RAM and flash
+#ifndef HTTP_METRICS
+#ifdef __AVR__
+#define HTTP_METRICS 0
+#else
+#define HTTP_METRICS 1
+#endif
+#endif
 
 // Define some of the common methods and headers here
 // That lets other code reuse them without having to declare another copy
 // of them, so saves code space and RAM
+#define HTTP_USER_AGENT    "Arduino/2.2.0"
 #define HTTP_METHOD_GET    "GET"
 #define HTTP_METHOD_POST   "POST"
 #define HTTP_METHOD_PUT    "PUT"
 #define HTTP_METHOD_DELETE "DELETE"
+#define HTTP_METHOD_HEAD   "HEAD"
 #define HTTP_HEADER_CONTENT_LENGTH "Content-Length"
 #define HTTP_HEADER_CONNECTION     "Connection"
 #define HTTP_HEADER_USER_AGENT     "User-Agent"
+#define HTTP_HEADER_TRANSFER_ENCODING "Transfer-Encoding"
+#define HTTP_HEADER_CONTENT_RANGE  "Content-Range"
+#define HTTP_HEADER_RANGE          "Range"
+#define HTTP_HEADER_ETAG           "ETag"
+#define HTTP_HEADER_ACCEPT_ENCODING  "Accept-Encoding"
+#define HTTP_HEADER_CONTENT_ENCODING "Content-Encoding"
+#define HTTP_HEADER_LOCATION       "Location"
+#define HTTP_HEADER_CONTENT_TYPE   "Content-Type"
+#define HTTP_HEADER_VALUE_CLOSE      "close"
+#define HTTP_HEADER_VALUE_KEEP_ALIVE "keep-alive"
+#define HTTP_HEADER_VALUE_CHUNKED    "chunked"
+#define HTTP_HEADER_VALUE_GZIP       "gzip"
+#define HTTP_HEADER_VALUE_X_GZIP     "x-gzip"
+#define HTTP_HEADER_VALUE_DEFLATE    "deflate"
+
+/** Function called when HttpClient is waiting for data from the server.
+  It should return once data is available on aClient or aMaxWait
+  milliseconds have passed, whichever is first.  Returning early is fine;
+  HttpClient will check for data and call it again if need be.
+  This lets an RTOS or event loop block on the socket, or do other work,
+  rather than HttpClient calling delay()
+  @param aClient Client that we're waiting on
+  @param aMaxWait Longest time to wait, in milliseconds
+*/
+typedef void (*HttpWaitForDataCallback)(Client& aClient, uint32_t aMaxWait);
+
+#if HTTP_METRICS
+/** Where the time went in a request, and how much was sent and received.
+  The times are in microseconds, so they wrap after about 71 minutes
+*/
+struct HttpMetrics
+{
+    // Time taken to connect to the server, or 0 if an open connection was
+    // used
+    uint32_t iConnectTime;
+    bool iConnectionReused;
+    // Time from being connected to the last of the request (headers and
+    // any body) being passed to the Client
+    uint32_t iSendTime;
+    // Time from the request being sent to the end of the status line, and
+    // to the end of the headers
+    uint32_t iStatusTime;
+    uint32_t iHeadersTime;
+    // Time from the end of the headers to the end of the body.  If the body
+    // ends when the server closes the connection, that isn't seen until
+    // poll() notices or the request is finished with, so this can include
+    // time spent in between
+    uint32_t iBodyTime;
+    // Time from the start of the request to its end
+    uint32_t iTotalTime;
+    // Bytes of request passed to the Client, and of response read from it
+    // (including the status line and headers)
+    uint32_t iBytesSent;
+    uint32_t iBytesReceived;
+    // Number of calls to the Client's write() and read() which did so
+    uint32_t iWriteCalls;
+    uint32_t iReadCalls;
+    // Status code of the response, or 0 if it didn't get that far
+    int iStatusCode;
+};
+
+class HttpClient;
+
+/** Function called with the metrics for each request, once the end of its
+  body has been reached, or when it's given up on with stop() or by starting
+  the next request
+  @param aHttp HttpClient which made the request
+  @param aMetrics The metrics for the request
+  @param aContext The context passed to setMetricsCallback()
+*/
+typedef void (*HttpMetricsCallback)(HttpClient& aHttp, const HttpMetrics& aMetrics, void* aContext);
+#endif
+
+/** Something which decodes a response body sent with a Content-Encoding,
+  such as HttpInflater (in HttpInflater.h) for gzip and deflate.  The
+  encoded body is written into the decoder's input buffer as it arrives,
+  and decode() is called to get whatever can be decoded from it so far
+*/
+class HttpContentDecoder
+{
+public:
+    typedef enum {
+        eGzip,
+        eDeflate
+    } tEncoding;
+
+    /** Get ready to decode a new body
+      @param aEncoding How the body has been encoded
+    */
+    virtual void begin(tEncoding aEncoding) =0;
+
+    /** Find where to put more of the encoded body
+      @param aSpace Set to how many bytes can be written there
+      @return Where to write them
+    */
+    virtual uint8_t* inputBuffer(size_t& aSpace) =0;
+
+    /** Tell the decoder how much of the body was written to inputBuffer()
+    */
+    virtual void inputAdded(size_t aLength) =0;
+
+    /** Tell the decoder that the end of the encoded body has been reached,
+      so if it hasn't got to the end of its data the body was cut short
+    */
+    virtual void endOfInput() =0;
+
+    /** Decode as much of the input as possible
+      @param aBuffer Where to put the decoded data
+      @param aLength Size of aBuffer
+      @return Number of bytes decoded, which is 0 if more input is needed,
+              else an error
+    */
+    virtual int decode(uint8_t* aBuffer, size_t aLength) =0;
+
+    /** Test whether all of the body has been decoded, or decoding failed
+    */
+    virtual bool finished() =0;
+
+    /** Find out why decoding failed
+      @return HTTP_SUCCESS if it hasn't, else an error
+    */
+    virtual int error() =0;
+};
+
+/** Something which finds the addresses of servers for HttpClient, so it
+  can connect to them by address rather than leaving the Client to look the
+  name up every time.  HttpDnsCache (in HttpDnsCache.h) remembers them
+*/
+class HttpResolver
+{
+public:
+    /** Find the address of a server
+      @param aServerName Name of the server
+      @param aAddress Set to its address, if it's found
+      @return true if it was found
+    */
+    virtual bool lookup(const char* aServerName, IPAddress& aAddress) =0;
+
+    /** Let the resolver know that connecting to the address it gave for
+      aServerName failed, in case that's because it has changed
+    */
+    virtual void connectFailed(const char* /* aServerName */) {};
+};
+
+/** Where the body of a request comes from when it's sent with
+  HttpClient::sendBody(), so it can be sent a block at a time rather than
+  needing to be in RAM all at once
+*/
+class HttpBodySource
+{
+public:
+    /** Length of the body, if it's known before it is sent
+      @return The length, or -1 if it isn't known, in which case the body is
+              sent with chunked transfer-encoding
+    */
+    virtual long length() { return -1; };
+
+    /** Get the next piece of the body.  This should wait until there's
+      some of it to return
+      @param aBuffer Where to put it
+      @param aSize Most that can be put in aBuffer
+      @return Number of bytes put in aBuffer, 0 at the end of the body, or
+              an error
+    */
+    virtual int read(uint8_t* aBuffer, size_t aSize) =0;
+};
+
+/** HttpBodySource which reads the body from a Stream, such as a File on an
+  SD card, until it runs out or has read aLength bytes
+*/
+class HttpStreamBodySource : public HttpBodySource
+{
+public:
+    HttpStreamBodySource(Stream& aStream, long aLength =-1)
+     : iStream(&aStream), iLength(aLength) {};
+    virtual long length() { return iLength; };
+    virtual int read(uint8_t* aBuffer, size_t aSize)
+      { return iStream->readBytes((char*)aBuffer, aSize); };
+protected:
+    Stream* iStream;
+    long iLength;
+};
+
+// The fixed parts of HttpRequestTemplates are kept in flash on AVR, where
+// RAM is tight
+#ifdef __AVR__
+#define HTTP_PROGMEM PROGMEM
+#else
+#define HTTP_PROGMEM
+#endif
+
+/** A request to a fixed server and path, whose request line and standard
+  headers are put together at compile time.  Make one with
+  HTTP_REQUEST_TEMPLATE (or HTTP_REQUEST_TEMPLATE_PORT), and send it with
+  HttpClient::startRequest(const HttpRequestTemplate&, const char*)
+*/
+struct HttpRequestTemplate
+{
+    // Start of the request line, up to the end of the path
+    const char* iRequestLine;
+    // The end of the request line, then the Host and User-Agent headers
+    const char* iHeaders;
+    const char* iServerName;
+    uint16_t iServerPort;
+    bool iIsHead;
+};
+
+/** Define an HttpRequestTemplate called aName, for the default HTTP port.
+  All the other arguments must be string literals, e.g.
+    HTTP_REQUEST_TEMPLATE(kReadingPost, HTTP_METHOD_POST, "example.com", "/api/reading");
+*/
+#define HTTP_REQUEST_TEMPLATE(aName, aHttpMethod, aServerName, aURLPath) \
+    HTTP_REQUEST_TEMPLATE_HOST(aName, aHttpMethod, aServerName, 80, aServerName, aURLPath)
+
+/** Define an HttpRequestTemplate called aName, for a server on a port other
+  than 80.  aServerPort must be a number, not a constant or macro
+*/
+#define HTTP_REQUEST_TEMPLATE_PORT(aName, aHttpMethod, aServerName, aServerPort, aURLPath) \
+    HTTP_REQUEST_TEMPLATE_HOST(aName, aHttpMethod, aServerName, aServerPort, aServerName ":" #aServerPort, aURLPath)
+
+// Used by the two macros above, with the value for the Host header
+#define HTTP_REQUEST_TEMPLATE_HOST(aName, aHttpMethod, aServerName, aServerPort, aHost, aURLPath) \
+    static const char aName##RequestLine[] HTTP_PROGMEM = aHttpMethod " " aURLPath; \
+    static const char aName##Headers[] HTTP_PROGMEM = " HTTP/1.1\r\n" \
+        "Host: " aHost "\r\n" \
+        HTTP_HEADER_USER_AGENT ": " HTTP_USER_AGENT "\r\n"; \
+    static const HttpRequestTemplate aName = { aName##RequestLine, aName##Headers, \
+        aServerName, aServerPort, (aHttpMethod[0] == HTTP_METHOD_HEAD[0]) }
 
 class HttpClient : public Client
 {
 public:
     static const int kNoContentLengthHeader =-1;
+    // Most headers that can be asked for with captureHeaders()
+    static const uint8_t kMaxCapturedHeaders =8;
     static const int kHttpPort =80;
     static const char* kUserAgent;
 
@@ -53,6 +363,8 @@ public:
     /** Start a more complex request.
         Use this when you need to send additional headers in the request,
         but you will also need to call endRequest() when you are finished.
+        If keep-alive is enabled and a previous response is still open, this
+        will either keep the connection for the new request or close it
     */
     void beginRequest();
 
@@ -277,6 +589,45 @@ public:
                      const char* aHttpMethod,
                      const char* aUserAgent);
 
+    /** Send another request on the current connection without waiting for
+      the response to the previous one (HTTP pipelining), which saves a
+      round trip per request.  Keep-alive must be enabled, and the request
+      must go to the same server and port as the one that opened the
+      connection.  Only for requests without a body, such as GET.
+      The responses are read in the order the requests were sent: read the
+      first response as usual, then call nextResponse() to move on to the
+      response to the next request.  Redirects in any of the responses on
+      the connection aren't followed, so they're returned as they are
+      @param aServerName  Name of the server, as given to startRequest()
+      @param aServerPort  Port on the server, as given to startRequest()
+      @param aURLPath     Url to request
+      @param aHttpMethod  Type of HTTP request to make, e.g. "GET", "HEAD"
+      @param aUserAgent   User-Agent string to send.  If NULL the default
+                          user-agent kUserAgent will be sent
+      @return 0 if successful, else error
+    */
+    int queueRequest(const char* aServerName,
+                     uint16_t    aServerPort,
+                     const char* aURLPath,
+                     const char* aHttpMethod =HTTP_METHOD_GET,
+                     const char* aUserAgent =NULL);
+
+    /** Move on to the response to the next pipelined request.  The body of
+      the current response must have been read to the end first (use
+      skipBody() if you don't want it).  Then call
+      responseStatusCode(), etc. as normal
+      @return HTTP_SUCCESS if successful, HTTP_ERROR_CONNECTION_CLOSED if the
+              server has closed (or is closing) the connection, in which
+              case pipelinedRequests() requests need to be sent again, or
+              another error code
+    */
+    int nextResponse();
+
+    /** Number of pipelined requests whose responses we haven't moved on to
+      yet (not counting the current response)
+    */
+    uint8_t pipelinedRequests() { return iPipelined; };
+
     /** Send an additional header line.  This can only be called in between the
       calls to startRequest and finishRequest.
       @param aHeader Header line to send, in its entirety (but without the
@@ -303,6 +654,13 @@ public:
     */
     void sendHeader(const char* aHeaderName, const int aHeaderValue);
 
+    /** Send a Range header asking for the resource from a given byte to the
+      end.  If the server supports it the response will be
+      206 Partial Content, and rangeStart() says where the body starts
+      @param aFirstByte Offset of the first byte wanted
+    */
+    void sendRange(unsigned long aFirstByte);
+
     /** Send a basic authentication header.  This will encode the given username
       and password, and send them in suitable header line for doing Basic
       Authentication.
@@ -311,16 +669,150 @@ public:
     */
     void sendBasicAuth(const char* aUser, const char* aPassword);
 
+    /** Connect to the server and start to send a request made from a
+      template.  Only the parts of the request which change need to be put
+      together now: any query string here, and any other headers (such as
+      Content-Length and authorization) with sendHeader(), etc. as normal.
+      Templates can't be sent through a proxy
+      @param aTemplate  The template, from HTTP_REQUEST_TEMPLATE
+      @param aQuery     Anything to add to the template's path, such as
+                        "?id=42", or NULL
+      @return 0 if successful, else error
+    */
+    int startRequest(const HttpRequestTemplate& aTemplate, const char* aQuery =NULL);
+
     /** Finish sending the HTTP request.  This basically just sends the blank
       line to signify the end of the request
     */
     void finishRequest();
 
+    /** Send the body of the request, reading it from aSource straight
+      into the buffer the request is sent from, so a block of up to
+      HTTP_SEND_BUFFER_SIZE bytes at a time.  This sends the Content-Length
+      header if aSource knows how long the body is, or sends the body with
+      chunked transfer-encoding if it doesn't, then ends the request.  Use
+      it between beginRequest() and the call to start the request (and any
+      sendHeader() calls), instead of endRequest(), and don't send a
+      Content-Length header yourself
+      @param aSource Where to read the body from
+      @return HTTP_SUCCESS if all of the body was sent, or an error, in
+              which case the connection will have been closed as the request
+              couldn't be finished
+    */
+    int sendBody(HttpBodySource& aSource);
+
+    /** Whether or not sendBody() sends "Expect: 100-continue", and waits
+      for the server to reply "100 Continue" before sending the body.  If
+      the server sends its final response instead (such as 401 or 413),
+      the body isn't sent at all, and the connection will be closed after
+      the response.  Off by default
+      @param aExpect true to wait for 100 Continue
+      @param aTimeout How long to wait for it, in milliseconds, before
+                      sending the body anyway (as older servers don't
+                      send it)
+    */
+    void setExpectContinue(bool aExpect, uint32_t aTimeout =kHttpContinueTimeout)
+      { iContinueTimeout = aExpect ? aTimeout : 0; };
+    bool expectContinue() { return (iContinueTimeout > 0); };
+
     /** Get the HTTP status code contained in the response.
       For example, 200 for successful request, 404 for file not found, etc.
+      This waits for the status line to arrive; see poll() for a way to
+      process the response without waiting.
+      If followRedirects() has been called, this follows any redirects and
+      returns the status code of the final response
+      @return The status code, HTTP_ERROR_CONNECTION_CLOSED if the server
+              closed the connection before sending it, else an error code
     */
     int responseStatusCode();
 
+    /** Have responseStatusCode() follow redirects (301, 302, 303, 307 and
+      308 responses to http: URLs) by making the request again to the
+      Location the server gives.  A 303 (or a 301 or 302 to a POST) is
+      followed with a GET; otherwise the method is kept, but a request which
+      had a body isn't followed as the body can't be sent again.  The
+      connection is reused if the new URL is on the same server and
+      setKeepAlive() is on.
+      Only requests started with a server name are followed, and only the
+      request line and standard headers are sent again, not those added with
+      sendHeader(), etc.  The headers of a redirect are read by
+      responseStatusCode(), so use captureHeaders() to get at them
+      @param aMaxRedirects Most redirects to follow for one request, or 0 to
+                           just get the Location with redirectLocation()
+      @param aBuffer Somewhere to keep the Location header, and the server
+                     and path it leads to.  It needs room for the server name
+                     and path of the request, plus the longest Location, plus
+                     2 bytes.  The request's method and user-agent strings
+                     aren't copied, so must still be around as well.  NULL
+                     turns redirect handling off again
+      @param aBufferSize Size of aBuffer, in bytes
+    */
+    void followRedirects(uint8_t aMaxRedirects, char* aBuffer, size_t aBufferSize)
+      { iMaxRedirects = aMaxRedirects; iRedirectBuffer = aBuffer; iRedirectBufferSize = aBufferSize; };
+
+    /** Number of redirects that responseStatusCode() followed to get to the
+      current response
+    */
+    uint8_t redirectCount() { return iRedirectCount; };
+
+    /** The Location of a redirect that responseStatusCode() didn't follow,
+      such as one to an https: URL, or when there were too many.  Only
+      available when followRedirects() has been given a buffer
+      @return The Location, or NULL if there isn't one.  It's only kept
+              until the next request
+    */
+    const char* redirectLocation() { return iLocationFound ? iRedirectBuffer + iLocationStart : NULL; };
+
+    /** Process as much of the response as has arrived, without waiting for
+      any more.  Call it repeatedly once the request has been sent (e.g. from
+      loop()) rather than calling responseStatusCode() and
+      skipResponseHeaders(), which block.  It reads the status line and skips
+      the headers; once it returns HTTP_POLL_READING_BODY the status code is
+      available from statusCode() and the body can be read with available()
+      and read() as it arrives.
+      Note that startRequest() (and so get(), post(), etc.) still connect and
+      send the request before returning, as the Client API only offers a
+      blocking connect()
+      @return HTTP_POLL_IN_PROGRESS, HTTP_POLL_READING_BODY or
+              HTTP_POLL_COMPLETE if all is well,
+              HTTP_ERROR_CONNECTION_CLOSED if the server closed the
+              connection before the end of a body whose length it gave (or
+              which was chunked), else an error code
+    */
+    int poll();
+
+    /** Return the status code of the response, once it has been read by
+      responseStatusCode() or poll()
+      @return The status code, or 0 if it hasn't been read yet
+    */
+    int statusCode() { return (iState >= eStatusCodeRead) ? iStatusCode : 0; };
+
+    /** Ask for the values of some of the response headers to be kept, so you
+      don't have to look for them with readHeader().  Call this before
+      responseStatusCode() (or poll()); it applies to every response after
+      that until it's called again.  The values are copied into aBuffer as
+      the headers are read, and can be got with capturedHeader() once the
+      headers have been processed.  Neither aHeaderNames, the names in it,
+      nor aBuffer are copied, so they must stay valid while in use.
+      @param aHeaderNames Names of the headers you want, e.g. "ETag".  They're
+                          matched ignoring case
+      @param aCount Number of names in aHeaderNames, up to
+                    kMaxCapturedHeaders.  Pass 0 to stop capturing headers
+      @param aBuffer Where to store the values.  Any value which doesn't fit
+                     in what's left of it is dropped
+      @param aBufferSize Size of aBuffer, in bytes
+    */
+    void captureHeaders(const char* const* aHeaderNames, uint8_t aCount,
+                        char* aBuffer, size_t aBufferSize);
+
+    /** Get the value of one of the headers asked for with captureHeaders()
+      @param aIndex Index of the header name in the aHeaderNames array
+      @return The value, without any surrounding whitespace, or NULL if the
+              header wasn't in the response (or its value didn't fit).  If
+              the header appeared more than once, this is the first value
+    */
+    const char* capturedHeader(uint8_t aIndex);
+
     /** Read the next character of the response headers.
       This functions in the same way as read() but to be used when reading
       through the headers.  Check whether or not the end of the headers has
@@ -335,7 +827,9 @@ public:
       returned in the response.  You can also use it after you've found all of
       the headers you're interested in, and just want to get on with processing
       the body.
-      @return HTTP_SUCCESS if successful, else an error code
+      @return HTTP_SUCCESS if successful, HTTP_ERROR_CONNECTION_CLOSED if
+              the server closed the connection before the end of the
+              headers, else an error code
     */
     int skipResponseHeaders();
 
@@ -345,47 +839,258 @@ public:
     bool endOfHeadersReached() { return (iState == eReadingBody); };
 
     /** Test whether the end of the body has been reached.
-      Only works if the Content-Length header was returned by the server
+      Only works if the Content-Length header was returned by the server, the
+      body is sent with chunked transfer-encoding, or the response can't have
+      a body (204 and 304 responses)
       @return true if we are now at the end of the body, else false
     */
     bool endOfBodyReached();
+
+    /** Test whether the end of the body has been reached, as it was sent
+      by the server rather than after any decoding done by
+      setContentDecoder().  This is what matters for reusing the connection
+    */
+    bool endOfRawBodyReached();
     virtual bool endOfStream() { return endOfBodyReached(); };
     virtual bool completed() { return endOfBodyReached(); };
 
+    /** Read and throw away the rest of the response body, in blocks, so
+      that the connection can be used for the next request (or pipelined
+      response) as soon as possible
+      @return HTTP_SUCCESS once the end of the body has been reached (or, if
+              its length isn't known, the server has closed the connection),
+              HTTP_ERROR_CONNECTION_CLOSED if the connection closed before the
+              end of the body, or another error code
+    */
+    int skipBody();
+
+    /** Read the next block of the body, waiting for some to arrive (until
+      one of the timeouts is hit) if none has yet.  read() returns straight
+      away when there's nothing to read, so this is easier for code that
+      just wants to work through the body
+      @param aBuffer Where to put the data
+      @param aSize Most bytes to read
+      @return Number of bytes read, 0 at the end of the body,
+              HTTP_ERROR_CONNECTION_CLOSED if the connection closed before the
+              end of the body, or another error code
+    */
+    int readBody(uint8_t* aBuffer, size_t aSize);
+
     /** Return the length of the body.
       @return Length of the body, in bytes, or kNoContentLengthHeader if no
-      Content-Length header was returned by the server
+      Content-Length header was returned by the server (which is always the
+      case for chunked responses)
+    */
+    long contentLength() { return iContentLength; };
+
+    /** Return how much of the body has been read so far
+      @return Number of bytes of the body read, after removing any chunked
+      transfer-encoding but before decoding any Content-Encoding (so it's
+      the amount that was transferred)
+    */
+    long bodyLengthConsumed() { return iBodyLengthConsumed; };
+
+    /** For a 206 Partial Content response, return where in the whole
+      resource the body starts, from the Content-Range header
+      @return Offset of the first byte of the body in the resource, or 0 if
+      there was no Content-Range header
     */
-    int contentLength() { return iContentLength; };
+    long rangeStart() { return iRangeStart; };
+
+    /** Return the length of the whole resource, from the Content-Range
+      header of a 206 Partial Content (or 416 Range Not Satisfiable) response
+      @return Length of the whole resource, or kNoContentLengthHeader if it
+      wasn't given
+    */
+    long rangeTotalLength() { return iRangeTotal; };
+
+    /** Number of writes made to the underlying Client to send the current
+      request.  Useful to check the request is going out in as few packets
+      as possible
+    */
+    uint16_t requestWriteCount() { return iRequest.writeCount(); };
+
+#if HTTP_METRICS
+    /** Metrics for the current request, so far.  Only available if
+      HTTP_METRICS is set
+    */
+    const HttpMetrics& metrics() { return iMetrics; };
+
+    /** Set a function to be called with the metrics for each request when
+      it ends.  Only available if HTTP_METRICS is set
+      @param aCallback Function to call, or NULL for none
+      @param aContext Passed to aCallback, for the caller's use
+    */
+    void setMetricsCallback(HttpMetricsCallback aCallback, void* aContext =NULL)
+      { iMetricsCallback = aCallback; iMetricsContext = aContext; };
+#endif
 
     // Inherited from Print
     // Note: 1st call to these indicates the user is sending the body, so if need
     // Note: be we should finish the header first
-    virtual size_t write(uint8_t aByte) { if (iState < eRequestSent) { finishHeaders(); }; return iClient-> write(aByte); };
-    virtual size_t write(const uint8_t *aBuffer, size_t aSize) { if (iState < eRequestSent) { finishHeaders(); }; return iClient->write(aBuffer, aSize); };
+    virtual size_t write(uint8_t aByte);
+    virtual size_t write(const uint8_t *aBuffer, size_t aSize);
+    /** Test whether the response body is being sent with chunked
+      transfer-encoding.  read() and friends remove the chunk framing for
+      you, so this is just for information
+    */
+    bool isResponseChunked() { return iIsChunked; };
+
+    /** Use a decoder for response bodies sent with a Content-Encoding.  The
+      Accept-Encoding header is sent with each request to tell the server
+      which encodings we understand, and read() and friends then return the
+      decoded body.  It only affects requests started after this is called
+      @param aDecoder Decoder to use, or NULL to only accept unencoded bodies
+    */
+    void setContentDecoder(HttpContentDecoder* aDecoder) { iDecoder = aDecoder; };
+
+    /** Look up the addresses of servers with a resolver (such as an
+      HttpDnsCache) and connect to them by address, rather than passing the
+      name to the Client.  The Host header still has the name.  One resolver
+      can be shared by several HttpClients
+      @param aResolver Resolver to use, or NULL to leave it to the Client
+    */
+    void setResolver(HttpResolver* aResolver) { iResolver = aResolver; };
+
+    /** Test whether the response body is being decoded by the decoder given
+      to setContentDecoder()
+    */
+    bool isResponseDecoded() { return iDecoding; };
+
     // Inherited from Stream
-    virtual int available() { return iClient->available(); };
+    virtual int available();
     /** Read the next byte from the server.
       @return Byte read or -1 if there are no bytes available.
     */
     virtual int read();
     virtual int read(uint8_t *buf, size_t size);
-    virtual int peek() { return iClient->peek(); };
+    virtual int peek();
     virtual void flush() { return iClient->flush(); };
 
     // Inherited from Client
     virtual int connect(IPAddress ip, uint16_t port) { return iClient->connect(ip, port); };
     virtual int connect(const char *host, uint16_t port) { return iClient->connect(host, port); };
     virtual void stop();
-    virtual uint8_t connected() { return iClient->connected(); };
+    virtual uint8_t connected() { return iClient->connected() || (iRxStart < iRxEnd); };
     virtual operator bool() { return bool(iClient); };
     virtual uint32_t httpResponseTimeout() { return iHttpResponseTimeout; };
+    /** Set how long the server can go without sending any of the response
+      before we give up with HTTP_ERROR_TIMED_OUT.  This applies from when
+      the request is sent, and between every part of the response after that
+      @param timeout Time in milliseconds
+    */
     virtual void setHttpResponseTimeout(uint32_t timeout) { iHttpResponseTimeout = timeout; };
+
+    /** Set how long connecting to the server may take.  HttpClient can't
+      stop a Client's connect() part way through, so also set the Client's
+      own connection timeout to this if it has one (such as
+      HttpSocketClient::setSocketTimeout()).  A connect() which fails after
+      at least this long gives HTTP_ERROR_CONNECT_TIMED_OUT rather than
+      HTTP_ERROR_CONNECTION_FAILED
+      @param aTimeout Time in milliseconds, or 0 to leave it to the Client
+    */
+    void setConnectTimeout(uint32_t aTimeout) { iConnectTimeout = aTimeout; };
+    uint32_t connectTimeout() { return iConnectTimeout; };
+
+    /** Set how long after the request is sent the first byte of the
+      response must arrive, else HTTP_ERROR_FIRST_BYTE_TIMED_OUT
+      @param aTimeout Time in milliseconds, or 0 for no limit other than the
+                      response timeout
+    */
+    void setFirstByteTimeout(uint32_t aTimeout) { iFirstByteTimeout = aTimeout; };
+    uint32_t firstByteTimeout() { return iFirstByteTimeout; };
+
+    /** Set the longest a request may take, from starting it to the end of
+      the body, else HTTP_ERROR_DEADLINE_EXCEEDED.  This stops a server which
+      sends the response slowly (but not slowly enough to hit the response
+      timeout) from holding on to us indefinitely
+      @param aDeadline Time in milliseconds, or 0 for no limit
+    */
+    void setRequestDeadline(uint32_t aDeadline) { iRequestDeadline = aDeadline; };
+    uint32_t requestDeadline() { return iRequestDeadline; };
+
+    /** Check the current request against all of the timeouts.  The calls
+      which wait for the response (responseStatusCode(),
+      skipResponseHeaders(), skipBody(), etc.) and poll() do this
+      themselves, but read() doesn't wait, so call this when it has nothing
+      for you
+      @return HTTP_SUCCESS if the request still has time, else the error for
+              the timeout that has passed
+    */
+    int checkTimeouts();
+
+    /** Set how long to pause for when we're waiting for the response and
+      there's no data available.  The first pause is aMinDelay milliseconds,
+      then each one is twice as long as the last, up to aMaxDelay.  It goes
+      back to aMinDelay whenever data arrives
+      @param aMinDelay Length of the first pause, in milliseconds
+      @param aMaxDelay Longest pause, in milliseconds
+    */
+    void setWaitForDataDelay(uint32_t aMinDelay, uint32_t aMaxDelay)
+      { iWaitForDataMinDelay = aMinDelay ? aMinDelay : 1; iWaitForDataMaxDelay = aMaxDelay; };
+
+    /** Set a function to be called to do the waiting when there's no data
+      available, rather than calling delay().  It is passed the pause length
+      worked out as for setWaitForDataDelay()
+      @param aCallback Function to call, or NULL to go back to using delay()
+    */
+    void setWaitForDataCallback(HttpWaitForDataCallback aCallback) { iWaitForDataCallback = aCallback; };
+
+    /** Whether or not we ask the server to keep the connection open after
+      the response, so that following requests to the same server and port
+      can be sent without connecting again.  Off by default.
+      A connection is only reused if the previous response body was read to
+      the end (which needs a Content-Length header), and the server didn't
+      reply with "Connection: close" or as an HTTP/1.0 server.  Call stop()
+      if you want to close the connection anyway.
+      If the server has closed a kept-alive connection while it was idle,
+      the request on it fails before any of the response arrives.  It's
+      then made once more on a new connection, as long as it was started
+      with a server name, had no body or headers of the caller's, and isn't
+      a POST
+    */
+    bool keepAlive() { return iKeepAlive; };
+    void setKeepAlive(bool aKeepAlive) { iKeepAlive = aKeepAlive; };
+
+    /** Test whether the connection can carry another request once the
+      current response has been read.
+      @return true if the connection will be reused by the next request
+    */
+    bool connectionReusable();
 protected:
-    /** Reset internal state data back to the "just initialised" state
+    /** Reset internal state data back to the "just initialised" state, ready
+      for the next request.  This doesn't touch the connection itself
     */
     void resetState();
 
+    /** Close the connection to the server, and throw away anything we'd
+      received on it
+    */
+    void closeConnection();
+
+    /** Finish with the previous request and response.  Closes the
+      connection unless it can be reused, then resets the request state
+    */
+    void endPreviousResponse();
+
+    /** Check if we're already connected to the given server
+      @param aServerName Name of the server, or NULL if we only have its IP
+      @param aServerAddress IP address of the server, if known
+      @param aServerPort Port on the server
+      @return true if the open connection can be used, else false (in which
+              case any open connection to another server is closed)
+    */
+    bool reuseConnection(const char* aServerName,
+                         const IPAddress& aServerAddress,
+                         uint16_t aServerPort);
+
+    /** Check if the server we last connected to is the given one
+      @return true if it's the same name (ignoring case), address and port
+    */
+    bool isCurrentServer(const char* aServerName,
+                         const IPAddress& aServerAddress,
+                         uint16_t aServerPort);
+
     /** Send the first part of the request and the initial headers.
       @param aServerName Name of the server being connected to.  If NULL, the
                          "Host" header line won't be sent
@@ -409,41 +1114,405 @@ protected:
     */
     void finishHeaders();
 
-    // Number of milliseconds that we wait each time there isn't any data
-    // available to be read (during status code and header processing)
-    static const int kHttpWaitForDataDelay = 1000;
+    /** Send the Connection and Accept-Encoding headers that every request
+      needs, which depend on our settings
+    */
+    void sendSettingsHeaders();
+
+    /** Follow a redirect, if we can, by reading the Location from the
+      headers and making the request again
+      @param aStatus Status code of the redirect response
+      @return HTTP_SUCCESS if the new request has been sent, aStatus if it
+              can't be followed, else an error
+    */
+    int followRedirect(int aStatus);
+
+    /** Make the request again on a new connection, if it failed because
+      the kept-alive connection it went on had been closed by the server
+      @param aError Why the request failed
+      @return HTTP_POLL_IN_PROGRESS if the request has been sent again,
+              aError if it can't be, else an error
+    */
+    int retryRequest(int aError);
+
+    /** Work out where a redirect leads, from the Location in iRedirectBuffer
+      and the current request.  The server name and path are left at the
+      start of iRedirectBuffer
+      @return true if it's a URL we can follow
+    */
+    bool resolveLocation();
+
+    /** Work out the error to return when the Client fails to connect
+    */
+    int connectFailed();
+
+    /** Connect to a server by name, looking it up with iResolver if we've
+      got one
+      @return HTTP_SUCCESS if connected, else an error
+    */
+    int connectByName(const char* aServerName, uint16_t aServerPort);
+
+    /** Test whether the current request has run past its deadline
+    */
+    bool deadlinePassed()
+      { return (iRequestDeadline > 0) && ((millis() - iRequestStartTime) >= iRequestDeadline); };
+
+    // Note the stages of the request in iMetrics, as they happen.  They do
+    // nothing without HTTP_METRICS
+#if HTTP_METRICS
+    void metricsStart();
+    void metricsConnected(bool aReused);
+    void metricsSent();
+    void metricsStatusRead();
+    void metricsHeadersRead();
+    void metricsReceived(int aLength) { if (aLength > 0) { iMetrics.iBytesReceived += aLength; iMetrics.iReadCalls++; } };
+    /** The request has ended, so pass its metrics on to the callback
+    */
+    void metricsFinish();
+#else
+    void metricsStart() {};
+    void metricsConnected(bool) {};
+    void metricsSent() {};
+    void metricsStatusRead() {};
+    void metricsHeadersRead() {};
+    void metricsReceived(int) {};
+    void metricsFinish() {};
+#endif
+
+    // These are the equivalents of iClient->available(), read(), etc. but
+    // they take any data in iRxBuffer first
+    int clientAvailable();
+    /** Test whether the server has closed the connection, and we've had
+      everything it sent before it did
+    */
+    bool serverClosed() { return !iClient->connected() && (clientAvailable() == 0); };
+    int clientRead();
+    int clientRead(uint8_t *buf, size_t size);
+    int clientPeek();
+
+    /** Read the next block of data from iClient into iRxBuffer.  Should only
+      be called when iRxBuffer is empty
+      @return true if any data was read
+    */
+    bool fillReceiveBuffer();
+
+    /** Skip over iRxBuffer up to the next '\n' (which isn't consumed), or to
+      the end of the buffer if there isn't one in it
+    */
+    void skipToEndOfLine();
+
+    /** Read through any chunked transfer-encoding framing (chunk sizes,
+      extensions, line endings and trailers) that's available
+      @return true if the next byte from iClient is part of the body data
+    */
+    bool readChunkFraming();
+
+    /** Read body data out of a chunked response
+      @return Number of bytes read, or -1 if none are available yet
+    */
+    int readChunked(uint8_t *buf, size_t size);
+
+    /** Wait for the server to reply to "Expect: 100-continue"
+      @return 100 if it wants the body (or we gave up waiting), its final
+              status code if it doesn't, or an error
+    */
+    int waitForContinue();
+
+    /** Read the body as it was sent, removing any chunked transfer-encoding
+      but not decoding any Content-Encoding
+      @return Number of bytes read, or -1 if none are available yet
+    */
+    int readRawBody(uint8_t *buf, size_t size);
+
+    /** Read the body through iDecoder, feeding it more of the raw body as
+      it needs it
+      @return Number of bytes read, or -1 if none are available yet
+    */
+    int readDecoded(uint8_t *buf, size_t size);
+
+    // These work through the response headers a character at a time for
+    // readHeader(), matching the header names against the ones we need and
+    // the ones the user wants, and processing the values of those
+    void startHeaderLine();
+    void matchHeaderName(char c);
+    void startHeaderValue();
+    void readHeaderValue(char c);
+    // Deal with the end of each token in the comma-separated list a
+    // Connection, Transfer-Encoding or Content-Encoding header can hold
+    void endHeaderToken();
+    void endHeaderValue();
+
+    /** Forget the values of any captured headers
+    */
+    void clearCapturedHeaders();
+
+    /** Process as much of the status line as has arrived, without waiting
+      @return The status code if we've read it all, HTTP_POLL_IN_PROGRESS if
+              we need more data, or an error code
+    */
+    int readStatusLine();
+
+    /** Process as many of the headers as have arrived, without waiting
+      @return true if any data was processed
+    */
+    bool readHeaders();
+
+    /** Pause while we wait for data to arrive, and work out how long the
+      next pause should be
+      @param aWaitDelay How long to pause, in milliseconds.  Updated to the
+                        length of the next pause
+    */
+    void waitForData(uint32_t& aWaitDelay);
+
+    // Size of the blocks skipBody() reads in
+    static const size_t kSkipBodyBlockSize = HTTP_RECEIVE_BUFFER_SIZE;
+
+    // Most requests that can be pipelined behind the current one
+    static const uint8_t kMaxPipelinedRequests = 7;
+
+    // Default range for the number of milliseconds that we wait each time
+    // there isn't any data available to be read (during status code and
+    // header processing)
+    static const int kHttpWaitForDataMinDelay = 1;
+    static const int kHttpWaitForDataMaxDelay = 100;
     // Number of milliseconds that we'll wait in total without receiveing any
     // data before returning HTTP_ERROR_TIMED_OUT (during status code and header
     // processing)
     static const int kHttpResponseTimeout = 30*1000;
-    static const char* kContentLengthPrefix;
+    // Default number of milliseconds sendBody() waits for 100 Continue
+    // before sending the body anyway
+    static const int kHttpContinueTimeout = 1000;
+    // Least room sendBody() needs for a chunk: one digit of size, its CRLF,
+    // a byte of data and the CRLF after it
+    static const size_t kMinChunkSpace = 6;
+    static const char* kStatusPrefix;
+    // The headers that HttpClient itself needs to know about
+    typedef enum {
+        eContentLengthHeader,
+        eConnectionHeader,
+        eTransferEncodingHeader,
+        eContentRangeHeader,
+        eContentEncodingHeader,
+        eLocationHeader,
+        kNumHeaders
+    } tHeaderId;
+    static const char* kHeaderNames[kNumHeaders];
+    static const char* kHeaderValueClose;
+    static const char* kHeaderValueChunked;
+    static const char* kHeaderValueGzip;
+    static const char* kHeaderValueXGzip;
+    static const char* kHeaderValueDeflate;
+    // Marks a captured header which we haven't got a value for
+    static const uint16_t kNoCapture =0xFFFF;
+    // Value of iContentEncoding when there's no encoding we can decode
+    static const uint8_t kNoContentEncoding =0xFF;
+
+    // Buffers up the pieces of the request so they can be sent to the Client
+    // in one go
+    class RequestBuffer : public Print
+    {
+    public:
+        RequestBuffer(Client* aClient) : iClient(aClient), iLength(0), iWriteCount(0), iBytesWritten(0) {};
+        virtual size_t write(uint8_t aByte);
+        virtual size_t write(const uint8_t *aBuffer, size_t aSize);
+        using Print::write;
+        /** Send anything that's buffered on to the Client
+        */
+        void flush();
+        /** Add a string from an HttpRequestTemplate, which is in flash on
+          AVR
+        */
+        void writeProgmem(const char* aString);
+        /** Room left at the end of the buffer, for data to be put straight
+          into.  Anything put there is sent once commit() has been called
+          @param aSize Set to how much room there is
+          @return Where the room starts
+        */
+        uint8_t* space(size_t& aSize) { aSize = sizeof(iBuffer) - iLength; return iBuffer + iLength; };
+        /** Add aLength bytes that have been put into space() to the buffer */
+        void commit(size_t aLength) { iLength += aLength; };
+        uint16_t writeCount() { return iWriteCount; };
+        uint32_t bytesWritten() { return iBytesWritten; };
+        void resetWriteCount() { iWriteCount = 0; iBytesWritten = 0; };
+        void setWriteCount(uint16_t aWriteCount, uint32_t aBytesWritten)
+          { iWriteCount = aWriteCount; iBytesWritten = aBytesWritten; };
+    protected:
+        Client* iClient;
+        uint8_t iBuffer[HTTP_SEND_BUFFER_SIZE];
+        size_t iLength;
+        // Number of writes we've made to iClient, and what they added up to
+        uint16_t iWriteCount;
+        uint32_t iBytesWritten;
+    };
     typedef enum {
         eIdle,
         eRequestStarted,
         eRequestSent,
         eReadingStatusCode,
+        eSkipToEndOfStatusLine,
         eStatusCodeRead,
-        eReadingContentLength,
+        eReadingHeaderValue,
         eSkipToEndOfHeader,
         eLineStartingCRFound,
         eReadingBody
     } tHttpState;
+    // Where we are in the framing of a chunked response body
+    typedef enum {
+        eChunkSize,
+        eChunkExtension,
+        eChunkData,
+        eChunkDataEnd,
+        eChunkTrailerStart,
+        eChunkTrailer,
+        eChunkBodyEnd
+    } tChunkState;
     // Ethernet client we're using
     Client* iClient;
+    // Where the request is gathered before being sent to iClient
+    RequestBuffer iRequest;
+    // Data received from iClient that we haven't processed yet, which runs
+    // from iRxBuffer[iRxStart] up to (but not including) iRxBuffer[iRxEnd]
+    uint8_t iRxBuffer[HTTP_RECEIVE_BUFFER_SIZE];
+    size_t iRxStart;
+    size_t iRxEnd;
     // Current state of the finite-state-machine
     tHttpState iState;
     // Stores the status code for the response, once known
     int iStatusCode;
+    // How far through the status line prefix we are
+    const char* iStatusPtr;
     // Stores the value of the Content-Length header, if present
-    int iContentLength;
+    long iContentLength;
     // How many bytes of the response body have been read by the user
-    int iBodyLengthConsumed;
-    // How far through a Content-Length header prefix we are
-    const char* iContentLengthPtr;
+    long iBodyLengthConsumed;
+    // Values from the Content-Range header, and which part of it we're
+    // reading
+    long iRangeStart;
+    long iRangeTotal;
+    uint8_t iRangeField;
+    // How far through the name of the current header line we are, and which
+    // of kHeaderNames and the captured headers it could still be, with one
+    // bit per header
+    uint8_t iHeaderNamePos;
+    uint8_t iHeaderMatch;
+    uint8_t iCaptureMatch;
+    // Which header's value we're reading, as a tHeaderId (or kNumHeaders
+    // for none) and an index into iCaptureNames (or kNoCapture)
+    uint8_t iHeaderId;
+    uint16_t iCaptureId;
+    // Whether we've got past any leading whitespace in the value
+    bool iHeaderValueStarted;
+    // How far through matching the token we're looking for against the
+    // current one in the value we are, or NULL if it isn't that token, and
+    // how many tokens there have been in the value
+    const char* iHeaderValuePtr;
+    uint8_t iHeaderTokenCount;
+    // Whether the body uses chunked transfer-encoding, and if so how far
+    // through the framing we are and how much of the current chunk is left
+    bool iIsChunked;
+    tChunkState iChunkState;
+    unsigned long iChunkLength;
+    // Decoder for Content-Encoding, if we're using one, what the current
+    // response's Content-Encoding is (or kNoContentEncoding), whether its
+    // body is being decoded, and any decoded byte that's been peek()ed at
+    HttpContentDecoder* iDecoder;
+    uint8_t iContentEncoding;
+    bool iDecoding;
+    int iDecodedPeek;
+    // What looks up server addresses, if the Client isn't left to
+    HttpResolver* iResolver;
     // Address of the proxy to use, if we're using one
     IPAddress iProxyAddress;
     uint16_t iProxyPort;
     uint32_t iHttpResponseTimeout;
+    // When we last received any of the response (or sent the request, if
+    // nothing has been received yet)
+    unsigned long iLastReadTime;
+    // The other timeouts, and when the current request was started and sent
+    // (from millis()), and whether any of its response has arrived yet
+    uint32_t iConnectTimeout;
+    uint32_t iFirstByteTimeout;
+    uint32_t iRequestDeadline;
+    unsigned long iRequestStartTime;
+    unsigned long iRequestSentTime;
+    bool iResponseStarted;
+    // How we wait for data when there isn't any available
+    uint32_t iWaitForDataMinDelay;
+    uint32_t iWaitForDataMaxDelay;
+    HttpWaitForDataCallback iWaitForDataCallback;
+    // Whether the user wants persistent connections
+    bool iKeepAlive;
+    // How long sendBody() waits for 100 Continue, or 0 if it doesn't ask
+    // for it, and whether it has arrived
+    uint32_t iContinueTimeout;
+    bool iContinueReceived;
+    // Number of requests sent after the one whose response we're reading
+    uint8_t iPipelined;
+    // Which of the outstanding requests were HEAD requests, starting with
+    // the current one in bit 0
+    uint8_t iHeadRequests;
+    // Set when the server has told us it'll close the connection after
+    // this response
+    bool iServerWillClose;
+    // Identity of the server we're currently connected to, so we can tell
+    // if the next request can use the same connection.  iServerName is ""
+    // if we only had its address, and iServerNameKept is false if its name
+    // was too long to keep
+    char iServerName[HTTP_SERVER_NAME_LENGTH+1];
+    bool iServerNameKept;
+    IPAddress iServerAddress;
+    uint16_t iServerPort;
+    // The headers the user wants to capture, and where to put their values
+    const char* const* iCaptureNames;
+    uint8_t iCaptureCount;
+    char* iCaptureBuffer;
+    size_t iCaptureBufferSize;
+    // Offset of each captured value in iCaptureBuffer, or kNoCapture
+    uint16_t iCapturedOffset[kMaxCapturedHeaders];
+    // How much of iCaptureBuffer is in use, and the length of the value
+    // currently being captured
+    size_t iCaptureUsed;
+    size_t iCaptureLength;
+    // The current request, in case we need to make it again for a redirect
+    // or on a new connection.  iRequestPath is NULL if it can't be.  Whether
+    // it had a body, or headers added by the caller, which we couldn't send
+    // again, and whether it went on a connection kept alive from before
+    const char* iRequestServerName;
+    uint16_t iRequestServerPort;
+    const char* iRequestPath;
+    const char* iRequestMethod;
+    const char* iRequestUserAgent;
+    bool iRequestHadBody;
+    bool iRequestHadHeaders;
+    bool iRequestReusedConnection;
+    // How many redirects we can follow, and have followed
+    uint8_t iMaxRedirects;
+    uint8_t iRedirectCount;
+    // Where the Location of a redirect (which starts at iLocationStart) and
+    // the server name and path it leads to are kept
+    char* iRedirectBuffer;
+    size_t iRedirectBufferSize;
+    size_t iLocationStart;
+    size_t iLocationLength;
+    // Whether we're reading the headers of a redirect we want to follow,
+    // and whether we've got its Location
+    bool iCapturingLocation;
+    bool iLocationFound;
+    // Whether we've already decided about following the current response
+    bool iRedirectChecked;
+#if HTTP_METRICS
+    HttpMetrics iMetrics;
+    HttpMetricsCallback iMetricsCallback;
+    void* iMetricsContext;
+    // When the current request started, was connected, was sent and had
+    // its headers read, from micros()
+    unsigned long iMetricsStarted;
+    unsigned long iMetricsConnected;
+    unsigned long iMetricsSent;
+    unsigned long iMetricsHeaders;
+    // Whether iMetrics is for a request which hasn't been reported yet
+    bool iMetricsPending;
+#endif
 };
 
 #endif
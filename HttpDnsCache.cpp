@@ -0,0 +1,90 @@
+// Cache of server addresses for HttpClient, so each server name is only
+// looked up in DNS once in a while rather than for every request
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpDnsCache.h"
+
+HttpDnsCache::HttpDnsCache(HttpHostByNameFunction aHostByName, uint32_t aTTL, uint32_t aFailureTTL)
+ : iHostByName(aHostByName), iTTL(aTTL), iFailureTTL(aFailureTTL), iHits(0), iMisses(0)
+{
+    clear();
+}
+
+void HttpDnsCache::clear()
+{
+    for (uint8_t i = 0; i < HTTP_DNS_CACHE_ENTRIES; i++)
+    {
+        iEntries[i].iName[0] = '\0';
+    }
+}
+
+HttpDnsCache::tEntry* HttpDnsCache::find(const char* aServerName)
+{
+    for (uint8_t i = 0; i < HTTP_DNS_CACHE_ENTRIES; i++)
+    {
+        // DNS names are case-insensitive
+        if ((iEntries[i].iName[0] != '\0') && (strcasecmp(iEntries[i].iName, aServerName) == 0))
+        {
+            return &iEntries[i];
+        }
+    }
+    return NULL;
+}
+
+bool HttpDnsCache::lookup(const char* aServerName, IPAddress& aAddress)
+{
+    if (!aServerName)
+    {
+        return false;
+    }
+    if (strlen(aServerName) > HTTP_DNS_CACHE_NAME_LENGTH)
+    {
+        // It's too long for us to keep
+        iMisses++;
+        return (iHostByName(aServerName, aAddress) == 1);
+    }
+    unsigned long now = millis();
+    tEntry* entry = find(aServerName);
+    if (entry && ((now - entry->iTime) < (entry->iFailed ? iFailureTTL : iTTL)))
+    {
+        iHits++;
+        aAddress = entry->iAddress;
+        return !entry->iFailed;
+    }
+
+    iMisses++;
+    IPAddress address;
+    bool found = (iHostByName(aServerName, address) == 1);
+    if (!entry)
+    {
+        // Use an empty entry if there is one, otherwise replace the oldest
+        entry = &iEntries[0];
+        for (uint8_t i = 0; (i < HTTP_DNS_CACHE_ENTRIES) && (entry->iName[0] != '\0'); i++)
+        {
+            if ((iEntries[i].iName[0] == '\0') || ((now - iEntries[i].iTime) > (now - entry->iTime)))
+            {
+                entry = &iEntries[i];
+            }
+        }
+    }
+    strcpy(entry->iName, aServerName);
+    entry->iAddress = address;
+    entry->iTime = now;
+    entry->iFailed = !found;
+    if (found)
+    {
+        aAddress = address;
+    }
+    return found;
+}
+
+void HttpDnsCache::connectFailed(const char* aServerName)
+{
+    // The server may have moved, so look it up again next time
+    tEntry* entry = aServerName ? find(aServerName) : NULL;
+    if (entry)
+    {
+        entry->iName[0] = '\0';
+    }
+}
@@ -0,0 +1,108 @@
+// Cache of server addresses for HttpClient, so each server name is only
+// looked up in DNS once in a while rather than for every request
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpDnsCache_h
+#define HttpDnsCache_h
+
+#include "HttpClient.h"
+
+// Number of server names an HttpDnsCache remembers the address of
+#ifndef HTTP_DNS_CACHE_ENTRIES
+#ifdef __AVR__
+#define HTTP_DNS_CACHE_ENTRIES 2
+#else
+#define HTTP_DNS_CACHE_ENTRIES 8
+#endif
+#endif
+
+// Longest server name an HttpDnsCache can remember the address of.  Each
+// entry keeps a copy of the name, so that different names can't be mixed
+// up; longer names aren't cached, and are looked up for every request
+#ifndef HTTP_DNS_CACHE_NAME_LENGTH
+#ifdef __AVR__
+#define HTTP_DNS_CACHE_NAME_LENGTH 31
+#else
+#define HTTP_DNS_CACHE_NAME_LENGTH 63
+#endif
+#endif
+
+/** Function which looks up the address of a server, as WiFi.hostByName()
+  and DNSClient::getHostByName() do.  For example:
+    int lookUp(const char* aHostName, IPAddress& aAddress)
+    {
+        return WiFi.hostByName(aHostName, aAddress);
+    }
+  @param aHostName Name of the server
+  @param aAddress Set to its address, if it's found
+  @return 1 if the address was found, anything else if not
+*/
+typedef int (*HttpHostByNameFunction)(const char* aHostName, IPAddress& aAddress);
+
+/** Remembers the addresses of the servers HttpClients connect to, so they
+  only need looking up again once they're older than the cache's TTL.
+  Names that can't be looked up are remembered too, for a shorter time, so
+  a server that's missing doesn't cost a DNS lookup for every request.
+  One cache can be shared by any number of HttpClients: pass it to
+  HttpClient::setResolver() for each of them.
+  The time to live of the DNS records themselves isn't available from the
+  lookup functions, so the same TTL is used for every name
+*/
+class HttpDnsCache : public HttpResolver
+{
+public:
+    /** Create a cache
+      @param aHostByName Function to look up names which aren't in the cache
+      @param aTTL How long to keep addresses for, in milliseconds
+      @param aFailureTTL How long to remember that a name couldn't be looked
+                         up for, in milliseconds
+    */
+    HttpDnsCache(HttpHostByNameFunction aHostByName, uint32_t aTTL =kDefaultTTL,
+                 uint32_t aFailureTTL =kDefaultFailureTTL);
+
+    virtual bool lookup(const char* aServerName, IPAddress& aAddress);
+    virtual void connectFailed(const char* aServerName);
+
+    /** Forget all of the addresses, such as after the network changes */
+    void clear();
+
+    /** Number of lookups answered from the cache, including ones for names
+      which are remembered as not found
+    */
+    unsigned long hits() { return iHits; };
+
+    /** Number of lookups which had to call the lookup function */
+    unsigned long misses() { return iMisses; };
+
+    // Default time to keep addresses for (5 minutes), and to remember that
+    // a name wasn't found for (10 seconds)
+    static const uint32_t kDefaultTTL = 300000UL;
+    static const uint32_t kDefaultFailureTTL = 10000UL;
+
+protected:
+    struct tEntry
+    {
+        // The server name, or "" for an empty entry
+        char iName[HTTP_DNS_CACHE_NAME_LENGTH+1];
+        IPAddress iAddress;
+        // When it was looked up, from millis()
+        unsigned long iTime;
+        // Whether the lookup failed
+        bool iFailed;
+    };
+
+    /** Find the entry for aServerName
+      @return The entry, or NULL if there isn't one
+    */
+    tEntry* find(const char* aServerName);
+
+    HttpHostByNameFunction iHostByName;
+    uint32_t iTTL;
+    uint32_t iFailureTTL;
+    tEntry iEntries[HTTP_DNS_CACHE_ENTRIES];
+    unsigned long iHits;
+    unsigned long iMisses;
+};
+
+#endif
@@ -0,0 +1,93 @@
+// Resumable downloads of large resources (such as firmware images) with
+// HttpClient, using Range requests
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpDownload.h"
+
+static const char* kDownloadHeaders[] = { HTTP_HEADER_ETAG };
+
+HttpDownload::HttpDownload(HttpClient& aHttp)
+ : iHttp(&aHttp), iStartOffset(0), iTotalLength(HttpClient::kNoContentLengthHeader)
+{
+    iETag[0] = '\0';
+}
+
+int HttpDownload::start(const char* aServerName, uint16_t aServerPort, const char* aURLPath,
+                        unsigned long aOffset, const char* aETag, const char* aUserAgent)
+{
+    iStartOffset = 0;
+    iTotalLength = HttpClient::kNoContentLengthHeader;
+
+    iHttp->beginRequest();
+    int ret = iHttp->startRequest(aServerName, aServerPort, aURLPath, HTTP_METHOD_GET, aUserAgent);
+    if (ret != HTTP_SUCCESS)
+    {
+        return ret;
+    }
+    if (aOffset > 0)
+    {
+        iHttp->sendRange(aOffset);
+        if (aETag && *aETag)
+        {
+            // Only send the range if the resource hasn't changed, otherwise
+            // we want all of it
+            iHttp->sendHeader(HTTP_HEADER_IF_RANGE, aETag);
+        }
+    }
+    iHttp->endRequest();
+
+    // aETag could be iETag, so we can't capture the new one until the
+    // request has gone
+    iHttp->captureHeaders(kDownloadHeaders, 1, iETag, sizeof(iETag));
+    ret = iHttp->responseStatusCode();
+    if (ret < 0)
+    {
+        return ret;
+    }
+    int err = iHttp->skipResponseHeaders();
+    if (err != HTTP_SUCCESS)
+    {
+        return err;
+    }
+    if (iHttp->capturedHeader(0) == NULL)
+    {
+        iETag[0] = '\0';
+    }
+
+    if (ret == 206)
+    {
+        if ((unsigned long)iHttp->rangeStart() != aOffset)
+        {
+            // Not the part we asked for, so we can't use it
+            return HTTP_ERROR_INVALID_RESPONSE;
+        }
+        iStartOffset = aOffset;
+        iTotalLength = iHttp->rangeTotalLength();
+    }
+    else if (ret == 200)
+    {
+        // We're getting all of it
+        iTotalLength = iHttp->contentLength();
+    }
+    else if (ret == 416)
+    {
+        // Tells us how long the resource actually is
+        iTotalLength = iHttp->rangeTotalLength();
+    }
+    return ret;
+}
+
+unsigned long HttpDownload::offset()
+{
+    return iStartOffset + iHttp->bodyLengthConsumed();
+}
+
+bool HttpDownload::complete()
+{
+    if (iTotalLength != HttpClient::kNoContentLengthHeader)
+    {
+        return (offset() >= (unsigned long)iTotalLength);
+    }
+    return iHttp->endOfBodyReached();
+}
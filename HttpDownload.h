@@ -0,0 +1,92 @@
+// Resumable downloads of large resources (such as firmware images) with
+// HttpClient, using Range requests
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpDownload_h
+#define HttpDownload_h
+
+#include "HttpClient.h"
+
+#define HTTP_HEADER_IF_RANGE "If-Range"
+
+// Longest ETag (including its quotes and a terminating '\0') that will be
+// kept to resume against.  Longer ones are dropped, so resuming will still
+// work but won't check that the resource hasn't changed in between
+#ifndef HTTP_DOWNLOAD_ETAG_SIZE
+#ifdef __AVR__
+#define HTTP_DOWNLOAD_ETAG_SIZE 32
+#else
+#define HTTP_DOWNLOAD_ETAG_SIZE 64
+#endif
+#endif
+
+/** Downloads a resource in one or more goes, carrying on from where the
+  last attempt got to rather than starting again if the connection drops.
+  Keep offset() (and etag(), so a changed resource isn't spliced onto the
+  old one) somewhere safe as the body is written out, and pass them back to
+  start() to resume.
+  If the server doesn't support ranges it sends the whole resource again,
+  and start() returns 200 rather than 206 - in which case offset() is back
+  to 0 and whatever was saved so far must be thrown away.
+  HttpDownload uses captureHeaders() on the HttpClient for its own purposes.
+  Ranges are of the body as sent, so don't use it with an HttpClient that
+  has a content decoder
+*/
+class HttpDownload
+{
+public:
+    HttpDownload(HttpClient& aHttp);
+
+    /** Make the request, and read the response status and headers.  Read
+      the body from the HttpClient as normal afterwards
+      @param aServerName  Name of the server being connected to
+      @param aServerPort  Port to connect to on the server
+      @param aURLPath     Url to request
+      @param aOffset      How much of the resource we already have, or 0 to
+                          download it all
+      @param aETag        ETag of the resource we have part of, or NULL.  If
+                          it has changed the server sends all of it again
+      @param aUserAgent   User-Agent string to send.  If NULL the default
+                          user-agent kUserAgent will be sent
+      @return 206 if the download is resuming from aOffset, 200 if it is
+              starting again from the beginning, another status code if the
+              server didn't send the resource (416 means aOffset is past the
+              end of it), else an error
+    */
+    int start(const char* aServerName, uint16_t aServerPort, const char* aURLPath,
+              unsigned long aOffset =0, const char* aETag =NULL,
+              const char* aUserAgent =NULL);
+
+    /** Offset in the whole resource of the next byte to be read from the
+      HttpClient
+    */
+    unsigned long offset();
+
+    /** Length of the whole resource, including any part we already had
+      @return The length, or HttpClient::kNoContentLengthHeader if the server
+              didn't say
+    */
+    long totalLength() { return iTotalLength; };
+
+    /** Test whether all of the resource has been downloaded
+      @return true if the whole resource has been read
+    */
+    bool complete();
+
+    /** ETag of the resource from the last response, to pass to start() when
+      resuming
+      @return The ETag, or NULL if the server didn't send one (or it didn't
+              fit)
+    */
+    const char* etag() { return iETag[0] ? iETag : NULL; };
+
+protected:
+    HttpClient* iHttp;
+    // Where in the resource the body of the current response starts
+    unsigned long iStartOffset;
+    long iTotalLength;
+    char iETag[HTTP_DOWNLOAD_ETAG_SIZE];
+};
+
+#endif
@@ -0,0 +1,64 @@
+// Keeps HttpCache validators in EEPROM, so they survive a reset
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+//
+// This is kept to a header, so that only sketches which use it need the
+// EEPROM library.  On ESP8266 and ESP32 call EEPROM.begin() with a size
+// large enough for the entries before using it
+
+#ifndef HttpEEPROMValidatorStore_h
+#define HttpEEPROMValidatorStore_h
+
+#include <EEPROM.h>
+#include "HttpCache.h"
+
+class HttpEEPROMValidatorStore : public HttpValidatorStore
+{
+public:
+    /** Create a store
+      @param aBaseAddress EEPROM address where the entries start
+      @param aEntries Number of entries.  They use sizeof(HttpValidators)
+                      bytes of EEPROM each
+    */
+    HttpEEPROMValidatorStore(int aBaseAddress, uint8_t aEntries)
+     : iBaseAddress(aBaseAddress), iEntries(aEntries ? aEntries : 1) {};
+
+    virtual bool load(uint32_t aKey, HttpValidators& aValidators)
+    {
+        uint8_t* p = (uint8_t*)&aValidators;
+        int address = entryAddress(aKey);
+        for (size_t i = 0; i < sizeof(HttpValidators); i++)
+        {
+            p[i] = EEPROM.read(address + i);
+        }
+        // Make sure a corrupted entry can't give us unterminated strings
+        aValidators.iETag[sizeof(aValidators.iETag)-1] = '\0';
+        aValidators.iLastModified[sizeof(aValidators.iLastModified)-1] = '\0';
+        return (aValidators.iKey == aKey);
+    };
+
+    virtual void save(const HttpValidators& aValidators)
+    {
+        const uint8_t* p = (const uint8_t*)&aValidators;
+        int address = entryAddress(aValidators.iKey);
+        for (size_t i = 0; i < sizeof(HttpValidators); i++)
+        {
+            // Only write what's changed, to save wear on the EEPROM
+            if (EEPROM.read(address + i) != p[i])
+            {
+                EEPROM.write(address + i, p[i]);
+            }
+        }
+#if defined(ESP8266) || defined(ESP32)
+        EEPROM.commit();
+#endif
+    };
+
+protected:
+    int entryAddress(uint32_t aKey) { return iBaseAddress + (aKey % iEntries)*sizeof(HttpValidators); };
+
+    int iBaseAddress;
+    uint8_t iEntries;
+};
+
+#endif
@@ -0,0 +1,65 @@
+// Keeps HttpCache validators in a file, for host (e.g. Linux) builds
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+//
+// This is kept to a header, so that it's only built where there's a C
+// library with stdio files
+
+#ifndef HttpFileValidatorStore_h
+#define HttpFileValidatorStore_h
+
+#include <stdio.h>
+#include "HttpCache.h"
+
+class HttpFileValidatorStore : public HttpValidatorStore
+{
+public:
+    /** Create a store
+      @param aPath Path of the file to keep the entries in.  It's created if
+                   it doesn't exist.  The string isn't copied
+      @param aEntries Number of entries to keep in the file
+    */
+    HttpFileValidatorStore(const char* aPath, uint16_t aEntries)
+     : iPath(aPath), iEntries(aEntries ? aEntries : 1) {};
+
+    virtual bool load(uint32_t aKey, HttpValidators& aValidators)
+    {
+        FILE* f = fopen(iPath, "rb");
+        if (!f)
+        {
+            return false;
+        }
+        bool ret = (fseek(f, entryOffset(aKey), SEEK_SET) == 0) &&
+                   (fread(&aValidators, sizeof(aValidators), 1, f) == 1) &&
+                   (aValidators.iKey == aKey);
+        fclose(f);
+        aValidators.iETag[sizeof(aValidators.iETag)-1] = '\0';
+        aValidators.iLastModified[sizeof(aValidators.iLastModified)-1] = '\0';
+        return ret;
+    };
+
+    virtual void save(const HttpValidators& aValidators)
+    {
+        FILE* f = fopen(iPath, "r+b");
+        if (!f)
+        {
+            f = fopen(iPath, "w+b");
+        }
+        if (f)
+        {
+            if (fseek(f, entryOffset(aValidators.iKey), SEEK_SET) == 0)
+            {
+                fwrite(&aValidators, sizeof(aValidators), 1, f);
+            }
+            fclose(f);
+        }
+    };
+
+protected:
+    long entryOffset(uint32_t aKey) { return (long)(aKey % iEntries)*sizeof(HttpValidators); };
+
+    const char* iPath;
+    uint16_t iEntries;
+};
+
+#endif
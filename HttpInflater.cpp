@@ -0,0 +1,673 @@
+// Decoder for gzip and deflate Content-Encoding, for use with HttpClient
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpInflater.h"
+
+// Bits in the flags byte of a gzip header
+static const uint8_t kGzipFlagHeaderCrc = 0x02;
+static const uint8_t kGzipFlagExtra = 0x04;
+static const uint8_t kGzipFlagName = 0x08;
+static const uint8_t kGzipFlagComment = 0x10;
+
+// What the length and distance symbols mean (RFC 1951, section 3.2.5)
+static const uint16_t kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t kDistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const uint8_t kDistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+// The order the lengths of the code length code are sent in
+static const uint8_t kCodeLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// CRC-32 is worked out a nibble at a time, to keep this table small
+static const uint32_t kCrcTable[16] = {
+    0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL,
+    0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+    0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL,
+    0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL };
+
+HttpInflater::HttpInflater()
+{
+    iLengthCode.iSymbol = iLengthSymbols;
+    iDistanceCode.iSymbol = iDistanceSymbols;
+    begin(eGzip);
+}
+
+void HttpInflater::begin(tEncoding aEncoding)
+{
+    iEncoding = aEncoding;
+    iState = (aEncoding == eGzip) ? eGzipHeader : eZlibHeader;
+    iError = HTTP_SUCCESS;
+    iZlib = false;
+    iFinalBlock = false;
+    iInputStart = 0;
+    iInputEnd = 0;
+    iBitBuffer = 0;
+    iBitCount = 0;
+    iCopyLength = 0;
+    iWindowPos = 0;
+    iCheck = (aEncoding == eGzip) ? 0xFFFFFFFFUL : 1;
+    iTotalIn = 0;
+    iTotalOut = 0;
+}
+
+uint8_t* HttpInflater::inputBuffer(size_t& aSpace)
+{
+    if (iInputStart > 0)
+    {
+        // Move what's left to the start, to make as much room as we can
+        memmove(iInput, iInput + iInputStart, iInputEnd - iInputStart);
+        iInputEnd -= iInputStart;
+        iInputStart = 0;
+    }
+    aSpace = sizeof(iInput) - iInputEnd;
+    return iInput + iInputEnd;
+}
+
+void HttpInflater::inputAdded(size_t aLength)
+{
+    iInputEnd += aLength;
+    iTotalIn += aLength;
+}
+
+void HttpInflater::endOfInput()
+{
+    if (!finished())
+    {
+        // The body was cut short
+        iState = eError;
+        iError = HTTP_ERROR_DECODING_FAILED;
+    }
+}
+
+int HttpInflater::decode(uint8_t* aBuffer, size_t aLength)
+{
+    iOutput = aBuffer;
+    iOutputLength = aLength;
+    iOutputUsed = 0;
+    while (!finished())
+    {
+        // Remember where we are in the input, so we can come back here if
+        // it runs out part way through this step
+        uint8_t inputStart = iInputStart;
+        uint32_t bitBuffer = iBitBuffer;
+        uint8_t bitCount = iBitCount;
+        tStepResult result = step();
+        if (result == eStepNeedInput)
+        {
+            iInputStart = inputStart;
+            iBitBuffer = bitBuffer;
+            iBitCount = bitCount;
+            break;
+        }
+        else if (result == eStepOutputFull)
+        {
+            break;
+        }
+        else if (result == eStepFailed)
+        {
+            iState = eError;
+            iError = HTTP_ERROR_DECODING_FAILED;
+        }
+    }
+    // Hand over anything we decoded before reporting any error
+    return ((iOutputUsed == 0) && (iState == eError)) ? iError : (int)iOutputUsed;
+}
+
+HttpInflater::tStepResult HttpInflater::step()
+{
+    int b;
+    switch (iState)
+    {
+    case eGzipHeader:
+        {
+            // ID1, ID2, CM, FLG, then MTIME, XFL and OS which we don't need
+            uint8_t header[10];
+            for (uint8_t i = 0; i < sizeof(header); i++)
+            {
+                if ((b = bits(8)) < 0)
+                {
+                    return eStepNeedInput;
+                }
+                header[i] = b;
+            }
+            if ((header[0] != 0x1F) || (header[1] != 0x8B) || (header[2] != 8))
+            {
+                return eStepFailed;
+            }
+            iGzipFlags = header[3];
+            iState = eGzipExtraLength;
+        }
+        break;
+    case eGzipExtraLength:
+        iCount = 0;
+        if (iGzipFlags & kGzipFlagExtra)
+        {
+            int low = bits(8);
+            if ((low < 0) || ((b = bits(8)) < 0))
+            {
+                return eStepNeedInput;
+            }
+            iCount = low | (b << 8);
+        }
+        iState = eGzipExtra;
+        break;
+    case eGzipExtra:
+        if (iCount == 0)
+        {
+            iState = eGzipName;
+        }
+        else if (bits(8) < 0)
+        {
+            return eStepNeedInput;
+        }
+        else
+        {
+            iCount--;
+        }
+        break;
+    case eGzipName:
+    case eGzipComment:
+        // These are both '\0'-terminated, if they're there at all
+        if (iGzipFlags & ((iState == eGzipName) ? kGzipFlagName : kGzipFlagComment))
+        {
+            if ((b = bits(8)) < 0)
+            {
+                return eStepNeedInput;
+            }
+            if (b != 0)
+            {
+                break;
+            }
+        }
+        iState = (iState == eGzipName) ? eGzipComment : eGzipHeaderCrc;
+        break;
+    case eGzipHeaderCrc:
+        if ((iGzipFlags & kGzipFlagHeaderCrc) && ((bits(8) < 0) || (bits(8) < 0)))
+        {
+            return eStepNeedInput;
+        }
+        iState = eBlockHeader;
+        break;
+    case eZlibHeader:
+        {
+            // Content-Encoding: deflate should have a zlib header, but some
+            // servers send the raw deflate data, so look before we take it
+            if (iInputEnd - iInputStart < 2)
+            {
+                return eStepNeedInput;
+            }
+            uint8_t cmf = iInput[iInputStart];
+            uint8_t flg = iInput[iInputStart + 1];
+            if (((cmf & 0x0F) == 8) && (((cmf << 8) | flg) % 31 == 0))
+            {
+                if (((cmf >> 4) > 7) || (flg & 0x20))
+                {
+                    // Either an invalid window size, or it needs a preset
+                    // dictionary which we don't have
+                    return eStepFailed;
+                }
+                // Any back-reference further than our window will fail when
+                // we get to it, rather than failing now on the window size
+                // in the header, as most bodies are small enough not to care
+                iZlib = true;
+                iInputStart += 2;
+            }
+            iState = eBlockHeader;
+        }
+        break;
+    case eBlockHeader:
+        if ((b = bits(3)) < 0)
+        {
+            return eStepNeedInput;
+        }
+        iFinalBlock = b & 1;
+        switch (b >> 1)
+        {
+        case 0:
+            iState = eStoredHeader;
+            break;
+        case 1:
+            {
+                // Fixed Huffman codes (RFC 1951, section 3.2.6)
+                uint16_t i = 0;
+                for (; i < 144; i++) iLengths[i] = 8;
+                for (; i < 256; i++) iLengths[i] = 9;
+                for (; i < 280; i++) iLengths[i] = 7;
+                for (; i < kMaxLengthCodes; i++) iLengths[i] = 8;
+                for (; i < kMaxLengthCodes + kMaxDistanceCodes; i++) iLengths[i] = 5;
+                buildCode(iLengthCode, iLengths, kMaxLengthCodes);
+                buildCode(iDistanceCode, iLengths + kMaxLengthCodes, kMaxDistanceCodes);
+                iState = eCodes;
+            }
+            break;
+        case 2:
+            iState = eDynamicHeader;
+            break;
+        default:
+            return eStepFailed;
+        }
+        break;
+    case eStoredHeader:
+        {
+            // LEN and NLEN (its ones complement) start at the next byte
+            alignToByte();
+            uint8_t header[4];
+            for (uint8_t i = 0; i < sizeof(header); i++)
+            {
+                if ((b = bits(8)) < 0)
+                {
+                    return eStepNeedInput;
+                }
+                header[i] = b;
+            }
+            if ((header[0] != (uint8_t)~header[2]) || (header[1] != (uint8_t)~header[3]))
+            {
+                return eStepFailed;
+            }
+            iCount = header[0] | (header[1] << 8);
+            iState = eStored;
+        }
+        break;
+    case eStored:
+        if (iCount == 0)
+        {
+            iState = iFinalBlock ? eTrailer : eBlockHeader;
+        }
+        else if (iOutputUsed == iOutputLength)
+        {
+            return eStepOutputFull;
+        }
+        else if (iBitCount > 0)
+        {
+            // Use up the whole bytes left in the bit buffer first
+            if ((b = bits(8)) < 0)
+            {
+                return eStepNeedInput;
+            }
+            output(b);
+            iCount--;
+        }
+        else if (iInputStart == iInputEnd)
+        {
+            return eStepNeedInput;
+        }
+        else
+        {
+            // Then we can copy straight from the input
+            while ((iCount > 0) && (iInputStart < iInputEnd) && (iOutputUsed < iOutputLength))
+            {
+                output(iInput[iInputStart++]);
+                iCount--;
+            }
+        }
+        break;
+    case eDynamicHeader:
+        // HLIT, HDIST and HCLEN
+        if ((b = bits(14)) < 0)
+        {
+            return eStepNeedInput;
+        }
+        iLengthCount = (b & 0x1F) + 257;
+        iDistanceCount = ((b >> 5) & 0x1F) + 1;
+        iCodeLengthCount = (b >> 10) + 4;
+        if ((iLengthCount > 286) || (iDistanceCount > kMaxDistanceCodes))
+        {
+            return eStepFailed;
+        }
+        iCount = 0;
+        iState = eCodeLengthCodes;
+        break;
+    case eCodeLengthCodes:
+        if (iCount < iCodeLengthCount)
+        {
+            if ((b = bits(3)) < 0)
+            {
+                return eStepNeedInput;
+            }
+            iLengths[kCodeLengthOrder[iCount++]] = b;
+        }
+        else
+        {
+            // Any lengths which weren't sent are 0
+            for (; iCount < sizeof(kCodeLengthOrder); iCount++)
+            {
+                iLengths[kCodeLengthOrder[iCount]] = 0;
+            }
+            // We only need the code length code until we've read the lengths
+            // of the other codes, so it can borrow iLengthCode
+            if (!buildCode(iLengthCode, iLengths, sizeof(kCodeLengthOrder)))
+            {
+                return eStepFailed;
+            }
+            iCount = 0;
+            iState = eCodeLengths;
+        }
+        break;
+    case eCodeLengths:
+        if (iCount < iLengthCount + iDistanceCount)
+        {
+            int symbol = decodeSymbol(iLengthCode);
+            if (symbol == -1)
+            {
+                return eStepNeedInput;
+            }
+            else if (symbol < 0)
+            {
+                return eStepFailed;
+            }
+            if (symbol < 16)
+            {
+                iLengths[iCount++] = symbol;
+                break;
+            }
+            // Otherwise it's a run of lengths
+            uint8_t length = 0;
+            uint8_t repeat;
+            if (symbol == 16)
+            {
+                // Repeat the previous length 3-6 times
+                if (iCount == 0)
+                {
+                    return eStepFailed;
+                }
+                length = iLengths[iCount - 1];
+                b = bits(2);
+                repeat = 3 + b;
+            }
+            else if (symbol == 17)
+            {
+                // 3-10 zeros
+                b = bits(3);
+                repeat = 3 + b;
+            }
+            else
+            {
+                // 11-138 zeros
+                b = bits(7);
+                repeat = 11 + b;
+            }
+            if (b < 0)
+            {
+                return eStepNeedInput;
+            }
+            if (iCount + repeat > iLengthCount + iDistanceCount)
+            {
+                return eStepFailed;
+            }
+            while (repeat--)
+            {
+                iLengths[iCount++] = length;
+            }
+        }
+        else
+        {
+            // There must be a code for the end of the block
+            if ((iLengths[256] == 0) ||
+                !buildCode(iLengthCode, iLengths, iLengthCount) ||
+                !buildCode(iDistanceCode, iLengths + iLengthCount, iDistanceCount))
+            {
+                return eStepFailed;
+            }
+            iState = eCodes;
+        }
+        break;
+    case eCodes:
+        {
+            if (iOutputUsed == iOutputLength)
+            {
+                return eStepOutputFull;
+            }
+            int symbol = decodeSymbol(iLengthCode);
+            if (symbol == -1)
+            {
+                return eStepNeedInput;
+            }
+            else if (symbol < 0)
+            {
+                return eStepFailed;
+            }
+            if (symbol < 256)
+            {
+                // A literal byte
+                output(symbol);
+                break;
+            }
+            else if (symbol == 256)
+            {
+                // End of the block
+                iState = iFinalBlock ? eTrailer : eBlockHeader;
+                break;
+            }
+            // Otherwise it's a length, followed by a distance, to copy from
+            // what we've already decoded
+            symbol -= 257;
+            if (symbol >= (int)sizeof(kLengthExtra))
+            {
+                return eStepFailed;
+            }
+            if ((b = bits(kLengthExtra[symbol])) < 0)
+            {
+                return eStepNeedInput;
+            }
+            uint16_t length = kLengthBase[symbol] + b;
+            symbol = decodeSymbol(iDistanceCode);
+            if (symbol == -1)
+            {
+                return eStepNeedInput;
+            }
+            else if ((symbol < 0) || (symbol >= (int)sizeof(kDistanceExtra)))
+            {
+                return eStepFailed;
+            }
+            if ((b = bits(kDistanceExtra[symbol])) < 0)
+            {
+                return eStepNeedInput;
+            }
+            uint16_t distance = kDistanceBase[symbol] + b;
+            if ((distance > HTTP_INFLATE_WINDOW_SIZE) || (distance > iTotalOut))
+            {
+                // Either it's further back than we can remember, or it's
+                // before the start of the data
+                return eStepFailed;
+            }
+            iCopyLength = length;
+            iCopyDistance = distance;
+            iState = eMatch;
+        }
+        break;
+    case eMatch:
+        while ((iCopyLength > 0) && (iOutputUsed < iOutputLength))
+        {
+            output(iWindow[(uint16_t)(iWindowPos - iCopyDistance) & (HTTP_INFLATE_WINDOW_SIZE - 1)]);
+            iCopyLength--;
+        }
+        if (iCopyLength > 0)
+        {
+            return eStepOutputFull;
+        }
+        iState = eCodes;
+        break;
+    case eTrailer:
+        {
+            // The checks start at the next byte
+            alignToByte();
+            uint8_t trailer[8];
+            uint8_t trailerLength = (iEncoding == eGzip) ? 8 : (iZlib ? 4 : 0);
+            for (uint8_t i = 0; i < trailerLength; i++)
+            {
+                if ((b = bits(8)) < 0)
+                {
+                    return eStepNeedInput;
+                }
+                trailer[i] = b;
+            }
+            if (iEncoding == eGzip)
+            {
+                // CRC-32 and length of the decoded data, least significant
+                // byte first
+                uint32_t crc = 0;
+                uint32_t length = 0;
+                for (int8_t i = 3; i >= 0; i--)
+                {
+                    crc = (crc << 8) | trailer[i];
+                    length = (length << 8) | trailer[i + 4];
+                }
+                if ((crc != ~iCheck) || (length != (uint32_t)iTotalOut))
+                {
+                    return eStepFailed;
+                }
+            }
+            else if (iZlib)
+            {
+                // Adler-32 of the decoded data, most significant byte first
+                uint32_t adler = 0;
+                for (uint8_t i = 0; i < 4; i++)
+                {
+                    adler = (adler << 8) | trailer[i];
+                }
+                if (adler != iCheck)
+                {
+                    return eStepFailed;
+                }
+            }
+            iState = eDone;
+        }
+        break;
+    default:
+        break;
+    };
+    return eStepDone;
+}
+
+int HttpInflater::bits(uint8_t aCount)
+{
+    while (iBitCount < aCount)
+    {
+        if (iInputStart == iInputEnd)
+        {
+            return -1;
+        }
+        iBitBuffer |= (uint32_t)iInput[iInputStart++] << iBitCount;
+        iBitCount += 8;
+    }
+    int ret = iBitBuffer & ((1UL << aCount) - 1);
+    iBitBuffer >>= aCount;
+    iBitCount -= aCount;
+    return ret;
+}
+
+int HttpInflater::decodeSymbol(const tHuffman& aCode)
+{
+    // Fill up the bit buffer as far as we can, so we don't have to check
+    // the input for each bit
+    while ((iBitCount <= 24) && (iInputStart < iInputEnd))
+    {
+        iBitBuffer |= (uint32_t)iInput[iInputStart++] << iBitCount;
+        iBitCount += 8;
+    }
+
+    // Huffman codes are sent most significant bit first, so we build the
+    // code up a bit at a time until it falls within the codes of that length
+    uint16_t code = 0;
+    uint16_t first = 0;
+    uint16_t index = 0;
+    for (uint8_t len = 1; len < 16; len++)
+    {
+        if (iBitCount == 0)
+        {
+            return -1;
+        }
+        code |= iBitBuffer & 1;
+        iBitBuffer >>= 1;
+        iBitCount--;
+        uint16_t count = aCode.iCount[len];
+        if (code < (uint16_t)(first + count))
+        {
+            return aCode.iSymbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+bool HttpInflater::buildCode(tHuffman& aCode, const uint8_t* aLengths, uint16_t aCount)
+{
+    memset(aCode.iCount, 0, sizeof(aCode.iCount));
+    for (uint16_t i = 0; i < aCount; i++)
+    {
+        aCode.iCount[aLengths[i]]++;
+    }
+    aCode.iCount[0] = 0;
+
+    // Check there aren't more codes of any length than there's room for.
+    // Incomplete codes are fine, as long as the missing codes aren't used
+    int32_t left = 1;
+    for (uint8_t len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        left -= aCode.iCount[len];
+        if (left < 0)
+        {
+            return false;
+        }
+    }
+
+    // Put the symbols in order of their codes: by length, then by symbol
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (uint8_t len = 1; len < 15; len++)
+    {
+        offsets[len + 1] = offsets[len] + aCode.iCount[len];
+    }
+    for (uint16_t i = 0; i < aCount; i++)
+    {
+        if (aLengths[i] != 0)
+        {
+            aCode.iSymbol[offsets[aLengths[i]]++] = i;
+        }
+    }
+    return true;
+}
+
+void HttpInflater::output(uint8_t aByte)
+{
+    iWindow[iWindowPos] = aByte;
+    iWindowPos = (iWindowPos + 1) & (HTTP_INFLATE_WINDOW_SIZE - 1);
+    iOutput[iOutputUsed++] = aByte;
+    iTotalOut++;
+
+    if (iEncoding == eGzip)
+    {
+        iCheck ^= aByte;
+        iCheck = (iCheck >> 4) ^ kCrcTable[iCheck & 0x0F];
+        iCheck = (iCheck >> 4) ^ kCrcTable[iCheck & 0x0F];
+    }
+    else
+    {
+        // Adler-32 is two sums, modulo 65521
+        uint32_t a = (iCheck & 0xFFFF) + aByte;
+        if (a >= 65521)
+        {
+            a -= 65521;
+        }
+        uint32_t b = (iCheck >> 16) + a;
+        if (b >= 65521)
+        {
+            b -= 65521;
+        }
+        iCheck = (b << 16) | a;
+    }
+}
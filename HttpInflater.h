@@ -0,0 +1,181 @@
+// Decoder for gzip and deflate Content-Encoding, for use with HttpClient
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpInflater_h
+#define HttpInflater_h
+
+#include "HttpClient.h"
+
+// How much of the decoded body is kept for deflate to refer back to.  The
+// format allows up to 32KB back, which is too much for small boards, so
+// there they can only decode bodies from servers which have been set up to
+// compress with a smaller window (for zlib, windowBits of 9 for 512 bytes).
+// A body which refers back further than this fails with
+// HTTP_ERROR_DECODING_FAILED.  Must be a power of two, and no more than 32KB
+#ifndef HTTP_INFLATE_WINDOW_SIZE
+#ifdef __AVR__
+#define HTTP_INFLATE_WINDOW_SIZE 512
+#else
+#define HTTP_INFLATE_WINDOW_SIZE 32768
+#endif
+#endif
+
+#if (HTTP_INFLATE_WINDOW_SIZE & (HTTP_INFLATE_WINDOW_SIZE - 1)) || (HTTP_INFLATE_WINDOW_SIZE > 32768)
+#error HTTP_INFLATE_WINDOW_SIZE must be a power of two, and no more than 32768
+#endif
+
+// How much of the encoded body is buffered to be decoded.  It must be at
+// least 16 bytes, so that any one piece of the format fits
+#ifndef HTTP_INFLATE_INPUT_SIZE
+#ifdef __AVR__
+#define HTTP_INFLATE_INPUT_SIZE 16
+#else
+#define HTTP_INFLATE_INPUT_SIZE 64
+#endif
+#endif
+
+#if (HTTP_INFLATE_INPUT_SIZE < 16) || (HTTP_INFLATE_INPUT_SIZE > 255)
+#error HTTP_INFLATE_INPUT_SIZE must be between 16 and 255
+#endif
+
+/** Decodes bodies compressed with deflate (RFC 1951), either in gzip
+  (RFC 1952) or zlib (RFC 1950) format, as they arrive.  Nothing is
+  allocated on the heap.  Pass it to HttpClient::setContentDecoder()
+*/
+class HttpInflater : public HttpContentDecoder
+{
+public:
+    HttpInflater();
+
+    virtual void begin(tEncoding aEncoding);
+    virtual uint8_t* inputBuffer(size_t& aSpace);
+    virtual void inputAdded(size_t aLength);
+    virtual void endOfInput();
+    virtual int decode(uint8_t* aBuffer, size_t aLength);
+    virtual bool finished() { return (iState == eDone) || (iState == eError); };
+    virtual int error() { return iError; };
+
+    /** Number of bytes of encoded body decoded so far
+    */
+    unsigned long totalIn() { return iTotalIn; };
+
+    /** Number of bytes the body has decoded to so far
+    */
+    unsigned long totalOut() { return iTotalOut; };
+
+protected:
+    // A Huffman code, stored canonically as the number of codes of each
+    // length and the symbols in order of their codes
+    struct tHuffman
+    {
+        uint16_t iCount[16];
+        uint16_t* iSymbol;
+    };
+
+    typedef enum {
+        eGzipHeader,
+        eGzipExtraLength,
+        eGzipExtra,
+        eGzipName,
+        eGzipComment,
+        eGzipHeaderCrc,
+        eZlibHeader,
+        eBlockHeader,
+        eStoredHeader,
+        eStored,
+        eDynamicHeader,
+        eCodeLengthCodes,
+        eCodeLengths,
+        eCodes,
+        eMatch,
+        eTrailer,
+        eDone,
+        eError
+    } tInflateState;
+
+    // What a step through the format did
+    typedef enum {
+        eStepDone,
+        eStepNeedInput,
+        eStepOutputFull,
+        eStepFailed
+    } tStepResult;
+
+    /** Decode the next piece of the format, which is either all done or (if
+      the input runs out part way) not done at all
+    */
+    tStepResult step();
+
+    /** Take the next aCount bits (no more than 15) of input
+      @return The bits, or -1 if there aren't enough
+    */
+    int bits(uint8_t aCount);
+
+    /** Skip to the start of the next byte of input */
+    void alignToByte() { iBitBuffer >>= (iBitCount & 7); iBitCount &= ~7; };
+
+    /** Decode one symbol using aCode
+      @return The symbol, -1 if there isn't enough input, or -2 if it isn't a
+              valid code
+    */
+    int decodeSymbol(const tHuffman& aCode);
+
+    /** Build a Huffman code from the length of each symbol's code
+      @return false if the lengths don't make a valid code
+    */
+    bool buildCode(tHuffman& aCode, const uint8_t* aLengths, uint16_t aCount);
+
+    /** Add a byte to the window and the caller's buffer */
+    void output(uint8_t aByte);
+
+    // Most codes there can be for literals/lengths and for distances
+    static const uint16_t kMaxLengthCodes =288;
+    static const uint16_t kMaxDistanceCodes =30;
+
+    tInflateState iState;
+    int iError;
+    tEncoding iEncoding;
+    // Whether a deflate body has a zlib header and trailer
+    bool iZlib;
+    // Whether the current block is the last one
+    bool iFinalBlock;
+    uint8_t iGzipFlags;
+    // Encoded data waiting to be decoded, and the bits taken from it which
+    // haven't been used yet
+    uint8_t iInput[HTTP_INFLATE_INPUT_SIZE];
+    uint8_t iInputStart;
+    uint8_t iInputEnd;
+    uint32_t iBitBuffer;
+    uint8_t iBitCount;
+    // The codes for the current block
+    tHuffman iLengthCode;
+    tHuffman iDistanceCode;
+    uint16_t iLengthSymbols[kMaxLengthCodes];
+    uint16_t iDistanceSymbols[kMaxDistanceCodes];
+    // The code lengths of a dynamic block, as they're read, and how many of
+    // each sort there are
+    uint8_t iLengths[kMaxLengthCodes + kMaxDistanceCodes];
+    uint16_t iLengthCount;
+    uint8_t iDistanceCount;
+    uint8_t iCodeLengthCount;
+    // How far through the current piece of the format we are, such as the
+    // number of code lengths read, or the bytes of a stored block left
+    uint16_t iCount;
+    // Match still to be copied out of the window
+    uint16_t iCopyLength;
+    uint16_t iCopyDistance;
+    // The most recently decoded data, which matches refer back to
+    uint8_t iWindow[HTTP_INFLATE_WINDOW_SIZE];
+    uint16_t iWindowPos;
+    // Where decode() is putting the decoded data
+    uint8_t* iOutput;
+    size_t iOutputLength;
+    size_t iOutputUsed;
+    // CRC-32 (for gzip) or Adler-32 (for zlib) of the decoded data
+    uint32_t iCheck;
+    unsigned long iTotalIn;
+    unsigned long iTotalOut;
+};
+
+#endif
@@ -0,0 +1,602 @@
+// Streaming JSON reader for HttpClient response bodies, which works through
+// the body a block at a time rather than needing all of it in RAM
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpJsonReader.h"
+
+// FNV-1a hash, which is kept for each key rather than its name
+static const uint32_t kHashStart = 2166136261UL;
+
+static uint32_t hashChar(uint32_t aHash, char aChar)
+{
+    return (aHash ^ (uint8_t)aChar) * 16777619UL;
+}
+
+HttpJsonReader::HttpJsonReader(HttpClient& aHttp, char* aValue, size_t aValueSize)
+ : iHttp(&aHttp), iValue(aValue), iValueSize(aValueSize), iValueLength(0),
+   iTruncated(false), iError(HTTP_SUCCESS), iState(eExpectValue), iToken(eEnd),
+   iPendingLevel(false), iDepth(0), iReadStart(0), iReadEnd(0)
+{
+    if (iValueSize > 0)
+    {
+        iValue[0] = '\0';
+    }
+}
+
+int HttpJsonReader::peekChar()
+{
+    if (iReadStart == iReadEnd)
+    {
+        if (iError != HTTP_SUCCESS)
+        {
+            return -1;
+        }
+        int ret = iHttp->readBody(iReadBuffer, sizeof(iReadBuffer));
+        if (ret <= 0)
+        {
+            // Either the end of the body, or an error
+            iError = ret;
+            return -1;
+        }
+        iReadStart = 0;
+        iReadEnd = ret;
+    }
+    return iReadBuffer[iReadStart];
+}
+
+int HttpJsonReader::readChar()
+{
+    int c = peekChar();
+    if (c >= 0)
+    {
+        iReadStart++;
+    }
+    return c;
+}
+
+int HttpJsonReader::peekToken()
+{
+    int c = peekChar();
+    while ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'))
+    {
+        iReadStart++;
+        c = peekChar();
+    }
+    return c;
+}
+
+void HttpJsonReader::addChar(char aChar)
+{
+    if (iValueLength + 1 < iValueSize)
+    {
+        iValue[iValueLength++] = aChar;
+        iValue[iValueLength] = '\0';
+    }
+    else
+    {
+        iTruncated = true;
+    }
+}
+
+HttpJsonReader::tToken HttpJsonReader::fail(int aError)
+{
+    if (iError == HTTP_SUCCESS)
+    {
+        iError = aError;
+    }
+    iToken = eError;
+    return eError;
+}
+
+void HttpJsonReader::endValue()
+{
+    iState = (iDepth == 0) ? eExpectNothing : eExpectCommaOrEnd;
+}
+
+HttpJsonReader::tToken HttpJsonReader::next()
+{
+    if (iError != HTTP_SUCCESS)
+    {
+        return fail(iError);
+    }
+    if (iPendingLevel)
+    {
+        if (iDepth == HTTP_JSON_MAX_DEPTH)
+        {
+            // Too deep for us to keep track of
+            return fail(HTTP_ERROR_INVALID_RESPONSE);
+        }
+        iLevels[iDepth].iKey = 0;
+        iLevels[iDepth].iIsArray = (iToken == eStartArray);
+        iDepth++;
+        iPendingLevel = false;
+    }
+    iValueLength = 0;
+    iTruncated = false;
+    if (iValueSize > 0)
+    {
+        iValue[0] = '\0';
+    }
+
+    if (iState == eExpectNothing)
+    {
+        // We've had the whole document.  Anything after it is ignored
+        iToken = eEnd;
+        return eEnd;
+    }
+
+    int c = peekToken();
+    if (c < 0)
+    {
+        // The body ended (or failed) part way through the document
+        return fail((iError != HTTP_SUCCESS) ? iError : HTTP_ERROR_INVALID_RESPONSE);
+    }
+
+    if (iState == eExpectCommaOrEnd)
+    {
+        tLevel& level = iLevels[iDepth-1];
+        if (c == ',')
+        {
+            iReadStart++;
+            if (level.iIsArray)
+            {
+                level.iKey++;
+                iState = eExpectValue;
+            }
+            else
+            {
+                iState = eExpectKey;
+            }
+            c = peekToken();
+            if (c < 0)
+            {
+                return fail((iError != HTTP_SUCCESS) ? iError : HTTP_ERROR_INVALID_RESPONSE);
+            }
+        }
+        else if (c == (level.iIsArray ? ']' : '}'))
+        {
+            iReadStart++;
+            iDepth--;
+            endValue();
+            iToken = level.iIsArray ? eEndArray : eEndObject;
+            return iToken;
+        }
+        else
+        {
+            return fail(HTTP_ERROR_INVALID_RESPONSE);
+        }
+    }
+
+    if ((iState == eExpectKeyOrEnd) || (iState == eExpectValueOrEnd))
+    {
+        if (c == ((iState == eExpectValueOrEnd) ? ']' : '}'))
+        {
+            // It's empty
+            iReadStart++;
+            iDepth--;
+            endValue();
+            iToken = (c == ']') ? eEndArray : eEndObject;
+            return iToken;
+        }
+        iState = (iState == eExpectValueOrEnd) ? eExpectValue : eExpectKey;
+    }
+
+    if (iState == eExpectKey)
+    {
+        if (c != '"')
+        {
+            return fail(HTTP_ERROR_INVALID_RESPONSE);
+        }
+        iReadStart++;
+        if (!readString(iLevels[iDepth-1].iKey))
+        {
+            return fail(HTTP_ERROR_INVALID_RESPONSE);
+        }
+        if (peekToken() != ':')
+        {
+            return fail(HTTP_ERROR_INVALID_RESPONSE);
+        }
+        iReadStart++;
+        iState = eExpectValue;
+        iToken = eKey;
+        return eKey;
+    }
+
+    // We're expecting a value
+    bool ok = true;
+    switch (c)
+    {
+    case '{':
+    case '[':
+        iReadStart++;
+        iPendingLevel = true;
+        iState = (c == '{') ? eExpectKeyOrEnd : eExpectValueOrEnd;
+        iToken = (c == '{') ? eStartObject : eStartArray;
+        return iToken;
+    case '"':
+        {
+            iReadStart++;
+            uint32_t hash;
+            ok = readString(hash);
+            iToken = eString;
+        }
+        break;
+    case 't':
+        ok = readLiteral("true");
+        iToken = eTrue;
+        break;
+    case 'f':
+        ok = readLiteral("false");
+        iToken = eFalse;
+        break;
+    case 'n':
+        ok = readLiteral("null");
+        iToken = eNull;
+        break;
+    default:
+        if ((c == '-') || ((c >= '0') && (c <= '9')))
+        {
+            ok = readNumber();
+            iToken = eNumber;
+        }
+        else
+        {
+            ok = false;
+        }
+        break;
+    };
+    if (!ok)
+    {
+        return fail(HTTP_ERROR_INVALID_RESPONSE);
+    }
+    endValue();
+    return iToken;
+}
+
+bool HttpJsonReader::readString(uint32_t& aHash)
+{
+    aHash = kHashStart;
+    while (true)
+    {
+        int c = readChar();
+        if (c < 0)
+        {
+            return false;
+        }
+        if (c == '"')
+        {
+            return true;
+        }
+        if (c == '\\')
+        {
+            c = readChar();
+            switch (c)
+            {
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+                {
+                    // That can be several bytes of UTF-8, so hash whatever
+                    // it adds
+                    size_t start = iValueLength;
+                    if (!readUnicodeEscape())
+                    {
+                        return false;
+                    }
+                    for (size_t i = start; i < iValueLength; i++)
+                    {
+                        aHash = hashChar(aHash, iValue[i]);
+                    }
+                }
+                continue;
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            default:
+                return false;
+            };
+        }
+        // Keys are matched by their hash, so it has to cover all of them,
+        // even if they don't all fit
+        aHash = hashChar(aHash, c);
+        addChar(c);
+    }
+}
+
+long HttpJsonReader::readHex4()
+{
+    long ret = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int c = readChar();
+        if ((c >= '0') && (c <= '9'))
+        {
+            ret = (ret << 4) | (c - '0');
+        }
+        else if ((c >= 'a') && (c <= 'f'))
+        {
+            ret = (ret << 4) | (c - 'a' + 10);
+        }
+        else if ((c >= 'A') && (c <= 'F'))
+        {
+            ret = (ret << 4) | (c - 'A' + 10);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return ret;
+}
+
+bool HttpJsonReader::readUnicodeEscape()
+{
+    long code = readHex4();
+    if (code < 0)
+    {
+        return false;
+    }
+    if ((code >= 0xD800) && (code <= 0xDBFF))
+    {
+        // The first half of a surrogate pair, so the second half should
+        // follow
+        if ((readChar() != '\\') || (readChar() != 'u'))
+        {
+            return false;
+        }
+        long low = readHex4();
+        if ((low < 0xDC00) || (low > 0xDFFF))
+        {
+            return false;
+        }
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+    // Add it as UTF-8.  A whole character is dropped rather than being
+    // cut short if it doesn't fit
+    char utf8[4];
+    uint8_t length;
+    if (code < 0x80)
+    {
+        utf8[0] = code;
+        length = 1;
+    }
+    else if (code < 0x800)
+    {
+        utf8[0] = 0xC0 | (code >> 6);
+        utf8[1] = 0x80 | (code & 0x3F);
+        length = 2;
+    }
+    else if (code < 0x10000)
+    {
+        utf8[0] = 0xE0 | (code >> 12);
+        utf8[1] = 0x80 | ((code >> 6) & 0x3F);
+        utf8[2] = 0x80 | (code & 0x3F);
+        length = 3;
+    }
+    else
+    {
+        utf8[0] = 0xF0 | (code >> 18);
+        utf8[1] = 0x80 | ((code >> 12) & 0x3F);
+        utf8[2] = 0x80 | ((code >> 6) & 0x3F);
+        utf8[3] = 0x80 | (code & 0x3F);
+        length = 4;
+    }
+    if (iValueLength + length < iValueSize)
+    {
+        for (uint8_t i = 0; i < length; i++)
+        {
+            addChar(utf8[i]);
+        }
+    }
+    else
+    {
+        iTruncated = true;
+    }
+    return true;
+}
+
+bool HttpJsonReader::readNumber()
+{
+    // Numbers are passed on as text, so we only need to find where they end
+    int c = peekChar();
+    while (((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') ||
+           (c == '.') || (c == 'e') || (c == 'E'))
+    {
+        addChar(c);
+        iReadStart++;
+        c = peekChar();
+    }
+    // A number at the top level ends at the end of the body, but if it
+    // ended because reading failed it could be cut short
+    return (iError == HTTP_SUCCESS);
+}
+
+bool HttpJsonReader::readLiteral(const char* aLiteral)
+{
+    while (*aLiteral)
+    {
+        if (readChar() != *aLiteral)
+        {
+            return false;
+        }
+        addChar(*aLiteral++);
+    }
+    return true;
+}
+
+bool HttpJsonReader::matches(const char* aPath)
+{
+    if (!aPath)
+    {
+        return false;
+    }
+    const char* p = aPath;
+    for (uint8_t i = 0; i < iDepth; i++)
+    {
+        if (iLevels[i].iIsArray)
+        {
+            if (*p != '[')
+            {
+                return false;
+            }
+            p++;
+            if (*p == '*')
+            {
+                p++;
+            }
+            else
+            {
+                if ((*p < '0') || (*p > '9'))
+                {
+                    return false;
+                }
+                uint32_t index = 0;
+                while ((*p >= '0') && (*p <= '9'))
+                {
+                    index = (index * 10) + (*p++ - '0');
+                }
+                if (index != iLevels[i].iKey)
+                {
+                    return false;
+                }
+            }
+            if (*p != ']')
+            {
+                return false;
+            }
+            p++;
+        }
+        else
+        {
+            if ((i > 0) && (*p == '.'))
+            {
+                p++;
+            }
+            const char* key = p;
+            uint32_t hash = kHashStart;
+            while (*p && (*p != '.') && (*p != '['))
+            {
+                hash = hashChar(hash, *p++);
+            }
+            if (p == key)
+            {
+                return false;
+            }
+            bool wildcard = ((p - key) == 1) && (*key == '*');
+            if (!wildcard && (hash != iLevels[i].iKey))
+            {
+                return false;
+            }
+        }
+    }
+    return (*p == '\0');
+}
+
+int HttpJsonReader::skip()
+{
+    if (iToken == eKey)
+    {
+        // Skip its value, which might be an object or array
+        tToken t = next();
+        if (t == eError)
+        {
+            return iError;
+        }
+        if ((t != eStartObject) && (t != eStartArray))
+        {
+            return HTTP_SUCCESS;
+        }
+    }
+    if ((iToken != eStartObject) && (iToken != eStartArray))
+    {
+        return HTTP_SUCCESS;
+    }
+    // We're back out of it when the depth returns to what it is now, as
+    // the level for it hasn't been added yet
+    uint8_t depth = iDepth;
+    do
+    {
+        tToken t = next();
+        if ((t == eError) || (t == eEnd))
+        {
+            return (t == eError) ? iError : HTTP_ERROR_INVALID_RESPONSE;
+        }
+    } while (!(((iToken == eEndObject) || (iToken == eEndArray)) && (iDepth == depth)));
+    return HTTP_SUCCESS;
+}
+
+bool HttpJsonReader::find(const char* aPath)
+{
+    while (true)
+    {
+        tToken t = next();
+        if ((t == eEnd) || (t == eError))
+        {
+            return false;
+        }
+        if ((t != eKey) && (t != eEndObject) && (t != eEndArray) && matches(aPath))
+        {
+            return true;
+        }
+    }
+}
+
+int HttpJsonReader::extract(HttpJsonField* aFields, uint8_t aCount)
+{
+    for (uint8_t i = 0; i < aCount; i++)
+    {
+        aFields[i].iFound = false;
+        if (aFields[i].iValueSize > 0)
+        {
+            aFields[i].iValue[0] = '\0';
+        }
+    }
+    uint8_t found = 0;
+    while (found < aCount)
+    {
+        tToken t = next();
+        if (t == eEnd)
+        {
+            break;
+        }
+        if (t == eError)
+        {
+            return iError;
+        }
+        if (t < eString)
+        {
+            // Only simple values are copied
+            continue;
+        }
+        for (uint8_t i = 0; i < aCount; i++)
+        {
+            HttpJsonField& field = aFields[i];
+            if (!field.iFound && matches(field.iPath))
+            {
+                if (field.iValueSize > 0)
+                {
+                    strncpy(field.iValue, iValue, field.iValueSize - 1);
+                    field.iValue[field.iValueSize - 1] = '\0';
+                }
+                field.iFound = true;
+                found++;
+            }
+        }
+    }
+    return found;
+}
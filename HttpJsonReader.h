@@ -0,0 +1,221 @@
+// Streaming JSON reader for HttpClient response bodies, which works through
+// the body a block at a time rather than needing all of it in RAM
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpJsonReader_h
+#define HttpJsonReader_h
+
+#include "HttpClient.h"
+
+// Deepest nesting of objects and arrays that can be read.  Each level takes
+// a few bytes of RAM, however big the document is
+#ifndef HTTP_JSON_MAX_DEPTH
+#ifdef __AVR__
+#define HTTP_JSON_MAX_DEPTH 8
+#else
+#define HTTP_JSON_MAX_DEPTH 16
+#endif
+#endif
+
+// Size of the blocks the body is read in, up to 255 bytes
+#ifndef HTTP_JSON_READ_BUFFER_SIZE
+#ifdef __AVR__
+#define HTTP_JSON_READ_BUFFER_SIZE 16
+#else
+#define HTTP_JSON_READ_BUFFER_SIZE 64
+#endif
+#endif
+
+/** A value to pull out of a document with HttpJsonReader::extract().  For
+  example:
+    char temperature[8];
+    char name[16];
+    HttpJsonField fields[] = {
+        { "sensors[0].temperature", temperature, sizeof(temperature) },
+        { "station.name", name, sizeof(name) }
+    };
+*/
+struct HttpJsonField
+{
+    // Path of the value, as for HttpJsonReader::matches()
+    const char* iPath;
+    // Where to copy the value, as text
+    char* iValue;
+    size_t iValueSize;
+    // Set by extract() if the value was found
+    bool iFound;
+};
+
+/** Reads the JSON body of a response as a series of tokens, one for each
+  key and value and for the start and end of each object and array, without
+  keeping more than one token's text at a time.  Strings have their escapes
+  decoded; numbers are left as text.
+  Call it once skipResponseHeaders() has been called on the HttpClient.  The
+  names of the enclosing keys aren't kept, only a hash of each of them, so
+  RAM use depends on how deeply the document is nested and not on its size.
+  Documents nested deeper than HTTP_JSON_MAX_DEPTH give an error
+*/
+class HttpJsonReader
+{
+public:
+    enum tToken
+    {
+        // The end of the document has been reached
+        eEnd,
+        // The document isn't valid JSON, or reading the body failed
+        eError,
+        eStartObject,
+        eEndObject,
+        eStartArray,
+        eEndArray,
+        // The name of a member of an object.  Its value is the next token
+        eKey,
+        eString,
+        eNumber,
+        eTrue,
+        eFalse,
+        eNull
+    };
+
+    /** Create a reader for the body of aHttp's current response
+      @param aHttp HttpClient to read the body from
+      @param aValue Buffer to put the text of each token in
+      @param aValueSize Size of aValue.  Text which doesn't fit is cut short,
+                        and truncated() says so
+    */
+    HttpJsonReader(HttpClient& aHttp, char* aValue, size_t aValueSize);
+
+    /** Read the next token
+      @return The type of token
+    */
+    tToken next();
+
+    /** Text of the last token: the decoded string for a key or string, the
+      number as it was sent, or "true", "false" or "null".  It's empty for
+      the start and end of objects and arrays
+    */
+    const char* value() { return iValue; };
+
+    /** Whether the last token's text was too long to fit in the buffer */
+    bool truncated() { return iTruncated; };
+
+    /** How many objects and arrays the last token is inside */
+    uint8_t depth() { return iDepth; };
+
+    /** Check where the last token is in the document.  Paths are made of
+      the keys and array indexes leading to it, such as "sensors[2].name".
+      Either can be "*" to match any key or index, as in "sensors[*].name".
+      The top-level value is at "".  A key token is at the same path as its
+      value, and the start and end of an object or array are at its path.
+      Keys are compared by hash, and keys containing '.' or '[' can't be
+      matched
+      @param aPath Path to check
+      @return true if the last token is at aPath
+    */
+    bool matches(const char* aPath);
+
+    /** Skip past the value of the last token: all of the object or array
+      that it starts, or for a key its value.  Does nothing for other tokens
+      @return HTTP_SUCCESS if successful, else an error
+    */
+    int skip();
+
+    /** Read on until a value (or the start of an object or array) at aPath
+      @param aPath Path of the value, as for matches()
+      @return true if it was found, false if the end of the document (or an
+              error) was reached first
+    */
+    bool find(const char* aPath);
+
+    /** Read through the document, copying the values at each of the paths
+      in aFields as they go past.  Only strings, numbers, true, false and
+      null are copied.  The first value matching each path is used, and
+      reading stops once every one is found, so skip the rest of the body
+      (or stop the HttpClient) afterwards
+      @param aFields Values to find
+      @param aCount Number of entries in aFields
+      @return Number of them found, or an error
+    */
+    int extract(HttpJsonField* aFields, uint8_t aCount);
+
+    /** Find out why eError was returned
+      @return HTTP_SUCCESS if there hasn't been an error, otherwise
+              HTTP_ERROR_INVALID_RESPONSE if the document isn't valid JSON (or
+              is nested too deeply), or the error from reading the body
+    */
+    int error() { return iError; };
+
+protected:
+    // What we expect to come next
+    enum tState
+    {
+        eExpectValue,
+        // At the start of an array
+        eExpectValueOrEnd,
+        // At the start of an object
+        eExpectKeyOrEnd,
+        eExpectKey,
+        eExpectCommaOrEnd,
+        eExpectNothing
+    };
+
+    struct tLevel
+    {
+        // Hash of the current key in an object, or the current index in an
+        // array
+        uint32_t iKey;
+        bool iIsArray;
+    };
+
+    /** Look at the next character of the body without using it up
+      @return The character, or -1 at the end of the body (or if reading it
+              fails)
+    */
+    int peekChar();
+    /** Read the next character of the body */
+    int readChar();
+    /** Skip whitespace, then peek at the next character */
+    int peekToken();
+    /** Add a character to the token's text */
+    void addChar(char aChar);
+    /** Read the rest of a string, after the opening quote, into the token's
+      text
+      @return true if successful
+    */
+    bool readString(uint32_t& aHash);
+    /** Decode a \u escape into the token's text
+      @return true if successful
+    */
+    bool readUnicodeEscape();
+    /** Read the four hex digits of a \u escape
+      @return The code unit, or -1 if they're not valid
+    */
+    long readHex4();
+    bool readNumber();
+    bool readLiteral(const char* aLiteral);
+    /** Update the state after reading a whole value */
+    void endValue();
+    /** Set the error, and return eError */
+    tToken fail(int aError);
+
+    HttpClient* iHttp;
+    char* iValue;
+    size_t iValueSize;
+    size_t iValueLength;
+    bool iTruncated;
+    int iError;
+    tState iState;
+    // The last token returned
+    tToken iToken;
+    // Whether the last token started an object or array, which we'll move
+    // into when the next token is read
+    bool iPendingLevel;
+    uint8_t iDepth;
+    tLevel iLevels[HTTP_JSON_MAX_DEPTH];
+    uint8_t iReadBuffer[HTTP_JSON_READ_BUFFER_SIZE];
+    uint8_t iReadStart;
+    uint8_t iReadEnd;
+};
+
+#endif
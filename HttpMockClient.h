@@ -0,0 +1,233 @@
+// Client which plays back a canned response, for trying out and timing
+// HttpClient without a network or a server
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+//
+// This is kept to a header, so that it's only built by sketches (and host
+// builds) which use it
+
+#ifndef HttpMockClient_h
+#define HttpMockClient_h
+
+#include <string.h>
+#include <Arduino.h>
+#include <Client.h>
+
+/** A Client which doesn't connect to anything.  Whatever is written to it
+  is counted (and kept, if it's given somewhere to put it), and reading from
+  it returns the response it's been given.  The response can be made to
+  arrive in fragments, with delays before and between them, to see how
+  HttpClient copes with a slow or bitty network.
+  Every connect() starts the response again from the beginning
+*/
+class HttpMockClient : public Client
+{
+public:
+    /** Create a mock client
+      @param aSent Buffer to keep what's written to the client in (which
+                   HttpClient fills with the request), or NULL not to keep it
+      @param aSentSize Size of aSent.  Anything written past the end is
+                       counted but not kept
+    */
+    HttpMockClient(uint8_t* aSent =NULL, size_t aSentSize =0)
+     : iResponse(NULL), iResponseLength(0), iFragmentSize(0),
+       iFirstByteDelay(0), iFragmentDelay(0), iCloseAtEnd(true),
+       iConnectResult(1), iConnected(false), iConnectTime(0),
+       iReadPos(0), iReleased(0), iSent(aSent), iSentSize(aSentSize),
+       iSentLength(0)
+    {
+        resetCounts();
+    };
+
+    /** Set the response to play back.  It isn't copied
+      @param aResponse The whole response, status line, headers and body
+      @param aLength Length of aResponse
+    */
+    void setResponse(const char* aResponse, size_t aLength)
+      { iResponse = (const uint8_t*)aResponse; iResponseLength = aLength; rewind(); };
+    void setResponse(const char* aResponse)
+      { setResponse(aResponse, strlen(aResponse)); };
+
+    /** Set how the response is split up as it arrives
+      @param aFragmentSize Most bytes which arrive at once, or 0 for all of it
+      @param aFirstByteDelay Time in milliseconds after connect() before the
+                             first fragment arrives
+      @param aFragmentDelay Time in milliseconds between fragments
+    */
+    void setFragments(size_t aFragmentSize, uint32_t aFirstByteDelay =0, uint32_t aFragmentDelay =0)
+      { iFragmentSize = aFragmentSize; iFirstByteDelay = aFirstByteDelay; iFragmentDelay = aFragmentDelay; };
+
+    /** Set whether the "server" closes the connection once it has sent all
+      of the response.  It does by default
+    */
+    void setCloseAtEnd(bool aClose) { iCloseAtEnd = aClose; };
+
+    /** Set what connect() returns, to try out failed connections
+      @param aResult 1 for success, otherwise a failure as returned by
+                     EthernetClient, etc.
+    */
+    void setConnectResult(int aResult) { iConnectResult = aResult; };
+
+    /** Number of times connect() has been called */
+    unsigned long connectCalls() { return iConnectCalls; };
+    /** Number of calls to read() (of either sort) which returned data */
+    unsigned long readCalls() { return iReadCalls; };
+    /** Number of calls to write() (of either sort) */
+    unsigned long writeCalls() { return iWriteCalls; };
+    /** Number of calls to available() */
+    unsigned long availableCalls() { return iAvailableCalls; };
+    /** Number of bytes written since the last connect() */
+    size_t sentLength() { return iSentLength; };
+    /** Number of bytes of the response read since the last connect() */
+    size_t receivedLength() { return iReadPos; };
+
+    /** Set all of the call counts back to 0 */
+    void resetCounts()
+      { iConnectCalls = 0; iReadCalls = 0; iWriteCalls = 0; iAvailableCalls = 0; };
+
+    virtual int connect(IPAddress, uint16_t aPort) { return connect((const char*)NULL, aPort); };
+    virtual int connect(const char*, uint16_t)
+    {
+        iConnectCalls++;
+        if (iConnectResult != 1)
+        {
+            return iConnectResult;
+        }
+        iConnected = true;
+        iConnectTime = millis();
+        iSentLength = 0;
+        rewind();
+        return 1;
+    };
+
+    virtual size_t write(uint8_t aByte) { return write(&aByte, 1); };
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize)
+    {
+        iWriteCalls++;
+        if (!iConnected)
+        {
+            return 0;
+        }
+        if (iSent && (iSentLength < iSentSize))
+        {
+            size_t toCopy = iSentSize - iSentLength;
+            memcpy(iSent+iSentLength, aBuffer, (aSize < toCopy) ? aSize : toCopy);
+        }
+        iSentLength += aSize;
+        return aSize;
+    };
+
+    virtual int available()
+    {
+        iAvailableCalls++;
+        release();
+        return iConnected ? (int)(iReleased - iReadPos) : 0;
+    };
+
+    virtual int read()
+    {
+        uint8_t b;
+        return (read(&b, 1) == 1) ? b : -1;
+    };
+
+    virtual int read(uint8_t* aBuffer, size_t aSize)
+    {
+        release();
+        if (!iConnected || (iReadPos == iReleased))
+        {
+            return -1;
+        }
+        if (aSize > iReleased - iReadPos)
+        {
+            aSize = iReleased - iReadPos;
+        }
+        iReadCalls++;
+        memcpy(aBuffer, iResponse+iReadPos, aSize);
+        iReadPos += aSize;
+        return aSize;
+    };
+
+    virtual int peek()
+    {
+        release();
+        return (iConnected && (iReadPos < iReleased)) ? iResponse[iReadPos] : -1;
+    };
+
+    virtual void flush() {};
+    virtual void stop() { iConnected = false; };
+
+    virtual uint8_t connected()
+    {
+        release();
+        // Data which has arrived can still be read after the server closes
+        return iConnected && (!iCloseAtEnd || (iReadPos < iResponseLength));
+    };
+
+    virtual operator bool() { return iConnected; };
+
+protected:
+    /** Start the response again from the beginning */
+    void rewind() { iReadPos = 0; iReleased = 0; };
+
+    /** Let through however much of the response has arrived by now */
+    void release()
+    {
+        if (!iConnected || (iReleased == iResponseLength))
+        {
+            return;
+        }
+        uint32_t elapsed = millis() - iConnectTime;
+        if (elapsed < iFirstByteDelay)
+        {
+            return;
+        }
+        if (iFragmentSize == 0)
+        {
+            iReleased = iResponseLength;
+            return;
+        }
+        // One fragment at the first byte delay, then another each fragment
+        // delay after that
+        uint32_t fragments = 1;
+        if (iFragmentDelay)
+        {
+            fragments += (elapsed - iFirstByteDelay) / iFragmentDelay;
+        }
+        else
+        {
+            // No delay between fragments, so they're all here but still
+            // have to be read one at a time
+            fragments = (iReadPos / iFragmentSize) + 1;
+        }
+        if (fragments > iResponseLength / iFragmentSize)
+        {
+            iReleased = iResponseLength;
+        }
+        else
+        {
+            iReleased = fragments * iFragmentSize;
+        }
+    };
+
+    const uint8_t* iResponse;
+    size_t iResponseLength;
+    size_t iFragmentSize;
+    uint32_t iFirstByteDelay;
+    uint32_t iFragmentDelay;
+    bool iCloseAtEnd;
+    int iConnectResult;
+    bool iConnected;
+    unsigned long iConnectTime;
+    // How much of the response has been read, and how much has "arrived"
+    size_t iReadPos;
+    size_t iReleased;
+    uint8_t* iSent;
+    size_t iSentSize;
+    size_t iSentLength;
+    unsigned long iConnectCalls;
+    unsigned long iReadCalls;
+    unsigned long iWriteCalls;
+    unsigned long iAvailableCalls;
+};
+
+#endif
@@ -0,0 +1,270 @@
+// multipart/form-data request bodies for HttpClient, put together as they're
+// sent so that the parts don't need to be copied into RAM
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpMultipartBody.h"
+
+#define HTTP_HEADER_VALUE_MULTIPART "multipart/form-data; boundary="
+
+HttpMultipartBody::HttpMultipartBody()
+ : iPartCount(0), iPart(0), iInHeader(true), iOffset(0)
+{
+    // The boundary mustn't turn up in any of the parts, so make it
+    // different each time.  Multiplying spreads the change across all of
+    // its digits
+    static uint16_t count = 0;
+    uint32_t seed = (micros() + ++count) * 2654435761UL;
+    strcpy(iBoundary, "ArduinoHttpClient");
+    for (uint8_t i = 17; i < kBoundaryLength; i++)
+    {
+        iBoundary[i] = "0123456789abcdef"[seed & 0x0F];
+        seed = (seed >> 4) | ((seed & 0x0F) << 28);
+    }
+    iBoundary[kBoundaryLength] = '\0';
+}
+
+bool HttpMultipartBody::validHeaderText(const char* aText, bool aQuoted)
+{
+    // A CR or LF would end the header early, and a '"' would end a quoted
+    // name early, letting the text add headers or parameters of its own
+    if (!aText)
+    {
+        return true;
+    }
+    for (; *aText; aText++)
+    {
+        if ((*aText == '\r') || (*aText == '\n') || (aQuoted && (*aText == '"')))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HttpMultipartBody::addPart(const char* aName, const char* aFileName, const char* aContentType,
+                                tPartType aType, const uint8_t* aData, HttpBodySource* aSource, long aLength)
+{
+    if ((iPartCount == HTTP_MULTIPART_MAX_PARTS) || !validHeaderText(aName, true) ||
+        !validHeaderText(aFileName, true) || !validHeaderText(aContentType, false))
+    {
+        return false;
+    }
+    tPart& part = iParts[iPartCount++];
+    part.iName = aName;
+    part.iFileName = aFileName;
+    part.iContentType = aContentType;
+    part.iType = aType;
+    part.iData = aData;
+    part.iSource = aSource;
+    part.iLength = aLength;
+    return true;
+}
+
+bool HttpMultipartBody::addField(const char* aName, const char* aValue)
+{
+    return addPart(aName, NULL, NULL, eRamData, (const uint8_t*)aValue, NULL, strlen(aValue));
+}
+
+bool HttpMultipartBody::addData(const char* aName, const char* aFileName, const char* aContentType,
+                                const uint8_t* aData, size_t aLength)
+{
+    return addPart(aName, aFileName, aContentType, eRamData, aData, NULL, aLength);
+}
+
+bool HttpMultipartBody::addProgmemData(const char* aName, const char* aFileName, const char* aContentType,
+                                       const uint8_t* aData, size_t aLength)
+{
+    return addPart(aName, aFileName, aContentType, eProgmemData, aData, NULL, aLength);
+}
+
+bool HttpMultipartBody::addSource(const char* aName, const char* aFileName, const char* aContentType,
+                                  HttpBodySource& aSource)
+{
+    return addPart(aName, aFileName, aContentType, eSourceData, NULL, &aSource, aSource.length());
+}
+
+bool HttpMultipartBody::rewind()
+{
+    for (uint8_t i = 0; i < iPartCount; i++)
+    {
+        if (iParts[i].iType == eSourceData)
+        {
+            // We can't get back what's already been read from it
+            return false;
+        }
+    }
+    iPart = 0;
+    iInHeader = true;
+    iOffset = 0;
+    return true;
+}
+
+void HttpMultipartBody::sendContentType(HttpClient& aHttp)
+{
+    char value[sizeof(HTTP_HEADER_VALUE_MULTIPART) + kBoundaryLength];
+    strcpy(value, HTTP_HEADER_VALUE_MULTIPART);
+    strcat(value, iBoundary);
+    aHttp.sendHeader(HTTP_HEADER_CONTENT_TYPE, value);
+}
+
+size_t HttpMultipartBody::copyHeader(uint8_t aPart, size_t aOffset, uint8_t* aBuffer, size_t aSize, size_t& aTotal)
+{
+    // Every boundary but the first ends the data of the part before
+    const char* pieces[13];
+    uint8_t count = 0;
+    pieces[count++] = (aPart > 0) ? "\r\n--" : "--";
+    pieces[count++] = iBoundary;
+    if (aPart == iPartCount)
+    {
+        pieces[count++] = "--\r\n";
+    }
+    else
+    {
+        const tPart& part = iParts[aPart];
+        pieces[count++] = "\r\nContent-Disposition: form-data; name=\"";
+        pieces[count++] = part.iName;
+        pieces[count++] = "\"";
+        if (part.iFileName)
+        {
+            pieces[count++] = "; filename=\"";
+            pieces[count++] = part.iFileName;
+            pieces[count++] = "\"";
+        }
+        pieces[count++] = "\r\n";
+        if (part.iContentType)
+        {
+            pieces[count++] = HTTP_HEADER_CONTENT_TYPE ": ";
+            pieces[count++] = part.iContentType;
+            pieces[count++] = "\r\n";
+        }
+        pieces[count++] = "\r\n";
+    }
+
+    size_t copied = 0;
+    aTotal = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        size_t length = strlen(pieces[i]);
+        if (aBuffer && (aOffset < aTotal + length) && (copied < aSize))
+        {
+            // Some of this piece is still to be copied
+            size_t start = (aOffset > aTotal) ? (aOffset - aTotal) : 0;
+            size_t toCopy = length - start;
+            if (toCopy > aSize - copied)
+            {
+                toCopy = aSize - copied;
+            }
+            memcpy(aBuffer + copied, pieces[i] + start, toCopy);
+            copied += toCopy;
+        }
+        aTotal += length;
+    }
+    return copied;
+}
+
+long HttpMultipartBody::length()
+{
+    long ret = 0;
+    size_t headerLength;
+    for (uint8_t i = 0; i < iPartCount; i++)
+    {
+        if (iParts[i].iLength < 0)
+        {
+            // We can't tell until it has all been sent
+            return -1;
+        }
+        copyHeader(i, 0, NULL, 0, headerLength);
+        ret += headerLength + iParts[i].iLength;
+    }
+    copyHeader(iPartCount, 0, NULL, 0, headerLength);
+    return ret + headerLength;
+}
+
+int HttpMultipartBody::readData(uint8_t* aBuffer, size_t aSize)
+{
+    tPart& part = iParts[iPart];
+    if ((part.iLength >= 0) && (aSize > (unsigned long)part.iLength - iOffset))
+    {
+        // Don't go past the end of it
+        aSize = part.iLength - iOffset;
+    }
+    if (aSize == 0)
+    {
+        return 0;
+    }
+    int ret;
+    switch (part.iType)
+    {
+    case eRamData:
+        memcpy(aBuffer, part.iData + iOffset, aSize);
+        ret = aSize;
+        break;
+    case eProgmemData:
+#ifdef __AVR__
+        memcpy_P(aBuffer, part.iData + iOffset, aSize);
+#else
+        memcpy(aBuffer, part.iData + iOffset, aSize);
+#endif
+        ret = aSize;
+        break;
+    default:
+        ret = part.iSource->read(aBuffer, aSize);
+        if ((ret == 0) && (part.iLength >= 0))
+        {
+            // It ran out before the length it gave, which we've already
+            // told the server
+            ret = HTTP_ERROR_BODY_TOO_SHORT;
+        }
+        break;
+    };
+    if (ret > 0)
+    {
+        iOffset += ret;
+    }
+    return ret;
+}
+
+int HttpMultipartBody::read(uint8_t* aBuffer, size_t aSize)
+{
+    // Fill as much of aBuffer as we can, so the headers go out in the same
+    // block as the data around them rather than in writes of their own
+    size_t filled = 0;
+    while ((filled < aSize) && (iPart <= iPartCount))
+    {
+        if (iInHeader)
+        {
+            size_t total;
+            size_t copied = copyHeader(iPart, iOffset, aBuffer + filled, aSize - filled, total);
+            filled += copied;
+            iOffset += copied;
+            if (iOffset == total)
+            {
+                iInHeader = false;
+                iOffset = 0;
+                if (iPart == iPartCount)
+                {
+                    // That was the closing boundary
+                    iPart++;
+                }
+            }
+        }
+        else
+        {
+            int ret = readData(aBuffer + filled, aSize - filled);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            if (ret == 0)
+            {
+                // On to the next part
+                iPart++;
+                iInHeader = true;
+                iOffset = 0;
+            }
+            filled += ret;
+        }
+    }
+    return filled;
+}
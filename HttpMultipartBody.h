@@ -0,0 +1,155 @@
+// multipart/form-data request bodies for HttpClient, put together as they're
+// sent so that the parts don't need to be copied into RAM
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpMultipartBody_h
+#define HttpMultipartBody_h
+
+#include "HttpClient.h"
+
+// Most parts an HttpMultipartBody can hold
+#ifndef HTTP_MULTIPART_MAX_PARTS
+#ifdef __AVR__
+#define HTTP_MULTIPART_MAX_PARTS 4
+#else
+#define HTTP_MULTIPART_MAX_PARTS 8
+#endif
+#endif
+
+/** A multipart/form-data body, as sent by an HTML form with file uploads.
+  Each part is a form field with a name, and optionally a filename and
+  content type, whose data comes from a buffer in RAM, from flash, or from
+  an HttpBodySource (such as an HttpStreamBodySource for a file).  Nothing
+  is copied: the boundaries and part headers are generated, and the data
+  read, a block at a time as the body is sent.  So any buffers, strings
+  and sources added must stay around until it has been sent.
+  For example:
+    HttpMultipartBody form;
+    HttpStreamBodySource image(file, file.size());
+    form.addField("camera", "porch");
+    form.addSource("snapshot", "snapshot.jpg", "image/jpeg", image);
+    http.beginRequest();
+    http.post(server, "/upload");
+    form.sendContentType(http);
+    http.sendBody(form);
+  If the length of every part is known the body is sent with a
+  Content-Length, otherwise it's sent with chunked transfer-encoding
+*/
+class HttpMultipartBody : public HttpBodySource
+{
+public:
+    HttpMultipartBody();
+
+    /** Add a simple form field
+      @param aName Name of the field
+      @param aValue Its value
+      @return true if it was added, false if there are already
+              HTTP_MULTIPART_MAX_PARTS parts, or if the name contains a '"',
+              CR or LF, which can't be sent in the part's header
+    */
+    bool addField(const char* aName, const char* aValue);
+
+    /** Add a part whose data is in RAM
+      @param aName Name of the field
+      @param aFileName Filename to give, or NULL for none
+      @param aContentType Content type of the data, or NULL for none
+      @param aData The data
+      @param aLength Length of aData
+      @return true if it was added.  As for addField(), the name and
+              filename can't contain a '"', CR or LF, and the content type
+              can't contain a CR or LF
+    */
+    bool addData(const char* aName, const char* aFileName, const char* aContentType,
+                 const uint8_t* aData, size_t aLength);
+
+    /** Add a part whose data is in flash (PROGMEM) on AVR.  Elsewhere this
+      is the same as addData()
+    */
+    bool addProgmemData(const char* aName, const char* aFileName, const char* aContentType,
+                        const uint8_t* aData, size_t aLength);
+
+    /** Add a part whose data is read from aSource as it's sent.  If
+      aSource doesn't know its length, the body is sent chunked
+      @return true if it was added
+    */
+    bool addSource(const char* aName, const char* aFileName, const char* aContentType,
+                   HttpBodySource& aSource);
+
+    /** Send the Content-Type header, with the boundary between the parts.
+      Call it before HttpClient::sendBody()
+    */
+    void sendContentType(HttpClient& aHttp);
+
+    /** Go back to the start, to send the body again.  Parts added with
+      addSource() can't be read again, so it can't be done if there are any
+      @return true if it went back to the start, false if there are parts
+              from an HttpBodySource
+    */
+    bool rewind();
+
+    /** Boundary between the parts */
+    const char* boundary() { return iBoundary; };
+
+    virtual long length();
+    virtual int read(uint8_t* aBuffer, size_t aSize);
+
+protected:
+    enum tPartType
+    {
+        eRamData,
+        eProgmemData,
+        eSourceData
+    };
+
+    struct tPart
+    {
+        const char* iName;
+        const char* iFileName;
+        const char* iContentType;
+        tPartType iType;
+        // iData is used for data in RAM or flash, iSource otherwise
+        const uint8_t* iData;
+        HttpBodySource* iSource;
+        // Length of the data, or -1 if it isn't known
+        long iLength;
+    };
+
+    bool addPart(const char* aName, const char* aFileName, const char* aContentType,
+                 tPartType aType, const uint8_t* aData, HttpBodySource* aSource, long aLength);
+
+    /** Check that aText can go in a part's header
+      @param aText Text to check, or NULL for none
+      @param aQuoted Whether it goes between quotes
+      @return true if it contains no CR or LF, nor a '"' if aQuoted
+    */
+    static bool validHeaderText(const char* aText, bool aQuoted);
+
+    /** Copy some of the boundary and headers in front of part aPart (or the
+      closing boundary, if aPart is iPartCount)
+      @param aOffset How far into them to start
+      @param aBuffer Where to copy them, or NULL just to find their length
+      @param aSize Most to copy
+      @param aTotal Set to their whole length
+      @return Number of bytes copied
+    */
+    size_t copyHeader(uint8_t aPart, size_t aOffset, uint8_t* aBuffer, size_t aSize, size_t& aTotal);
+
+    /** Read some of the data of the current part
+      @return Number of bytes read, 0 at the end of the part, or an error
+    */
+    int readData(uint8_t* aBuffer, size_t aSize);
+
+    static const uint8_t kBoundaryLength = 25;
+
+    tPart iParts[HTTP_MULTIPART_MAX_PARTS];
+    uint8_t iPartCount;
+    char iBoundary[kBoundaryLength+1];
+    // Where we've got to in sending the body: the part, whether we're in its
+    // header or data, and how far through that we are
+    uint8_t iPart;
+    bool iInHeader;
+    unsigned long iOffset;
+};
+
+#endif
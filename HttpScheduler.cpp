@@ -0,0 +1,148 @@
+// Class to run several HttpClient requests at the same time
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include "HttpScheduler.h"
+
+HttpScheduler::HttpScheduler(uint8_t aMaxConcurrent)
+ : iCount(0), iActive(0), iMaxConcurrent(aMaxConcurrent ? aMaxConcurrent : 1)
+{
+}
+
+int HttpScheduler::add(HttpClient& aHttp, const char* aServerName, uint16_t aServerPort, const char* aURLPath, const char* aHttpMethod, HttpCompletionCallback aCompletionCallback, HttpBodyCallback aBodyCallback, void* aContext)
+{
+    if (iCount >= HTTP_SCHEDULER_MAX_REQUESTS)
+    {
+        return HTTP_ERROR_SCHEDULER_FULL;
+    }
+    tRequest& req = iRequests[iCount++];
+    req.iHttp = &aHttp;
+    req.iServerName = aServerName;
+    req.iServerPort = aServerPort;
+    req.iURLPath = aURLPath;
+    req.iHttpMethod = aHttpMethod;
+    req.iCompletionCallback = aCompletionCallback;
+    req.iBodyCallback = aBodyCallback;
+    req.iContext = aContext;
+    req.iStarted = false;
+    return HTTP_SUCCESS;
+}
+
+uint8_t HttpScheduler::poll()
+{
+    uint8_t i = 0;
+    while (i < iCount)
+    {
+        bool running;
+        if (iRequests[i].iStarted)
+        {
+            running = processRequest(iRequests[i]);
+        }
+        else
+        {
+            running = startRequest(iRequests[i]);
+        }
+
+        if (running || !iRequests[i].iStarted)
+        {
+            i++;
+        }
+        else
+        {
+            // It's finished, so shuffle the later requests down to keep
+            // them in order
+            iCount--;
+            for (uint8_t j = i; j < iCount; j++)
+            {
+                iRequests[j] = iRequests[j+1];
+            }
+        }
+    }
+    return iCount;
+}
+
+void HttpScheduler::run()
+{
+    while (poll() > 0)
+    {
+        yield();
+    }
+}
+
+bool HttpScheduler::busy(HttpClient* aHttp)
+{
+    for (uint8_t i = 0; i < iCount; i++)
+    {
+        if (iRequests[i].iStarted && (iRequests[i].iHttp == aHttp))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpScheduler::startRequest(tRequest& aRequest)
+{
+    if ((iActive >= iMaxConcurrent) || busy(aRequest.iHttp))
+    {
+        // It'll have to wait its turn
+        return false;
+    }
+
+    aRequest.iStarted = true;
+    iActive++;
+    int ret = aRequest.iHttp->startRequest(aRequest.iServerName, aRequest.iServerPort, aRequest.iURLPath, aRequest.iHttpMethod, NULL);
+    if (ret != HTTP_SUCCESS)
+    {
+        finishRequest(aRequest, ret);
+        return false;
+    }
+    return true;
+}
+
+bool HttpScheduler::processRequest(tRequest& aRequest)
+{
+    HttpClient& http = *aRequest.iHttp;
+    int ret = http.poll();
+    if (ret == HTTP_POLL_READING_BODY)
+    {
+        // Pass on whatever of the body has arrived
+        uint8_t buf[kBodyBlockSize];
+        int len;
+        while ((len = http.read(buf, sizeof(buf))) > 0)
+        {
+            if (aRequest.iBodyCallback)
+            {
+                aRequest.iBodyCallback(http, buf, len, aRequest.iContext);
+            }
+        }
+        // See if that was the end of it
+        ret = http.poll();
+    }
+
+    if (ret < 0)
+    {
+        finishRequest(aRequest, ret);
+        return false;
+    }
+    else if (ret == HTTP_POLL_COMPLETE)
+    {
+        finishRequest(aRequest, http.statusCode());
+        return false;
+    }
+    return true;
+}
+
+void HttpScheduler::finishRequest(tRequest& aRequest, int aResult)
+{
+    iActive--;
+    HttpClient& http = *aRequest.iHttp;
+    if (aRequest.iCompletionCallback)
+    {
+        aRequest.iCompletionCallback(http, aResult, aRequest.iContext);
+    }
+    if ((aResult < 0) || !http.connectionReusable())
+    {
+        http.stop();
+    }
+}
@@ -0,0 +1,148 @@
+// Class to run several HttpClient requests at the same time
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef HttpScheduler_h
+#define HttpScheduler_h
+
+#include "HttpClient.h"
+
+// Most requests that can be queued up in an HttpScheduler at once.  Define
+// it before including HttpScheduler.h to change it
+#ifndef HTTP_SCHEDULER_MAX_REQUESTS
+#define HTTP_SCHEDULER_MAX_REQUESTS 8
+#endif
+
+/** Called as the body of a response arrives.
+  @param aHttp The HttpClient the request was made with
+  @param aData The next part of the body
+  @param aLength Number of bytes in aData
+  @param aContext The context pointer given when the request was added
+*/
+typedef void (*HttpBodyCallback)(HttpClient& aHttp, const uint8_t* aData, size_t aLength, void* aContext);
+
+/** Called when a request has finished.
+  @param aHttp The HttpClient the request was made with
+  @param aResult The status code of the response, or an error code if the
+                 request failed
+  @param aContext The context pointer given when the request was added
+*/
+typedef void (*HttpCompletionCallback)(HttpClient& aHttp, int aResult, void* aContext);
+
+/** Runs a number of requests, each on its own HttpClient, so that the time
+  spent waiting for one server overlaps with waiting for the others.
+  Add the requests, then call poll() from loop() (or run() to wait for them
+  all).  Each request's body is passed to its body callback as it arrives,
+  and the completion callback is called when it's done.
+*/
+class HttpScheduler
+{
+public:
+    // The W5100 Ethernet chip only has 4 sockets
+    static const uint8_t kDefaultMaxConcurrent =4;
+
+    /** Create a scheduler
+      @param aMaxConcurrent Most requests to have open at once.  Should be no
+                            more than the number of sockets the network
+                            hardware supports
+    */
+    HttpScheduler(uint8_t aMaxConcurrent =kDefaultMaxConcurrent);
+
+    /** Queue up a request.  Requests are started in the order they're added,
+      as long as fewer than the maximum are running and aHttp isn't busy
+      with an earlier request.  None of the strings are copied, so they must
+      stay valid until the request completes
+      @param aHttp HttpClient to make the request with
+      @param aServerName Name of the server to connect to
+      @param aServerPort Port to connect to on the server
+      @param aURLPath Url to request
+      @param aHttpMethod Type of HTTP request to make, e.g. "GET", "POST", etc.
+      @param aCompletionCallback Called when the request has finished, or NULL
+      @param aBodyCallback Called with the body as it arrives, or NULL to
+                           throw the body away
+      @param aContext Passed to the callbacks
+      @return HTTP_SUCCESS if the request was queued, else an error
+    */
+    int add(HttpClient& aHttp,
+            const char* aServerName,
+            uint16_t aServerPort,
+            const char* aURLPath,
+            const char* aHttpMethod,
+            HttpCompletionCallback aCompletionCallback,
+            HttpBodyCallback aBodyCallback =NULL,
+            void* aContext =NULL);
+
+    /** Queue up a GET request to port 80.  See the full version of add()
+    */
+    int add(HttpClient& aHttp,
+            const char* aServerName,
+            const char* aURLPath,
+            HttpCompletionCallback aCompletionCallback,
+            HttpBodyCallback aBodyCallback =NULL,
+            void* aContext =NULL)
+      { return add(aHttp, aServerName, HttpClient::kHttpPort, aURLPath, HTTP_METHOD_GET, aCompletionCallback, aBodyCallback, aContext); }
+
+    /** Start any requests that can be started, and process whatever has
+      arrived for those that are running.  Doesn't wait for data
+      @return Number of requests still queued or running
+    */
+    uint8_t poll();
+
+    /** Keep calling poll() until all of the requests have completed
+    */
+    void run();
+
+    /** Number of requests still queued or running
+    */
+    uint8_t pending() { return iCount; };
+
+    /** Number of requests currently running
+    */
+    uint8_t active() { return iActive; };
+
+    uint8_t maxConcurrent() { return iMaxConcurrent; };
+    void setMaxConcurrent(uint8_t aMaxConcurrent) { iMaxConcurrent = aMaxConcurrent ? aMaxConcurrent : 1; };
+
+protected:
+    // Size of the blocks we read response bodies in
+    static const size_t kBodyBlockSize =64;
+
+    typedef struct
+    {
+        HttpClient* iHttp;
+        const char* iServerName;
+        uint16_t iServerPort;
+        const char* iURLPath;
+        const char* iHttpMethod;
+        HttpCompletionCallback iCompletionCallback;
+        HttpBodyCallback iBodyCallback;
+        void* iContext;
+        bool iStarted;
+    } tRequest;
+
+    /** See if a request can be started, and start it
+      @return true if it's still running afterwards
+    */
+    bool startRequest(tRequest& aRequest);
+
+    /** Process whatever has arrived for a running request
+      @return true if it's still running afterwards
+    */
+    bool processRequest(tRequest& aRequest);
+
+    /** Tell the user a request has finished and tidy up after it
+    */
+    void finishRequest(tRequest& aRequest, int aResult);
+
+    /** Whether aHttp is being used by a running request
+    */
+    bool busy(HttpClient* aHttp);
+
+    // The requests, in the order they were added
+    tRequest iRequests[HTTP_SCHEDULER_MAX_REQUESTS];
+    uint8_t iCount;
+    uint8_t iActive;
+    uint8_t iMaxConcurrent;
+};
+
+#endif
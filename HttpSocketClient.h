@@ -0,0 +1,327 @@
+// Client using BSD sockets, so HttpClient can run on Linux and other POSIX
+// hosts
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+//
+// This is kept to a header, so that it's only built where there are
+// sockets to build it against
+
+#ifndef HttpSocketClient_h
+#define HttpSocketClient_h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <Arduino.h>
+#include <Client.h>
+
+// MSG_NOSIGNAL stops a write to a connection the server has closed from
+// killing us with SIGPIPE.  Not every platform has it
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/** A Client which makes TCP connections with the host's sockets.  The
+  socket is non-blocking, so reads return straight away when nothing has
+  arrived, as with the network hardware on a board.  Pass
+  HttpSocketClient::waitForData to HttpClient::setWaitForDataCallback() to
+  have HttpClient wait for data with poll() rather than sleeping
+*/
+class HttpSocketClient : public Client
+{
+public:
+    HttpSocketClient()
+     : iSocket(-1), iPeerClosed(false), iNoDelay(false), iReceiveBufferSize(0),
+       iSendBufferSize(0), iSocketTimeout(kDefaultSocketTimeout) {};
+    virtual ~HttpSocketClient() { stop(); };
+
+    /** Set whether Nagle's algorithm is turned off (with TCP_NODELAY) for
+      new connections, so small writes are sent straight away.  It's left on
+      by default
+    */
+    void setNoDelay(bool aNoDelay) { iNoDelay = aNoDelay; };
+
+    /** Set the size of the kernel's buffers for new connections
+      @param aReceiveSize Size of the receive buffer in bytes, or 0 to leave
+                          it at the system default
+      @param aSendSize Size of the send buffer in bytes, or 0 to leave it at
+                       the system default
+    */
+    void setBufferSizes(int aReceiveSize, int aSendSize)
+      { iReceiveBufferSize = aReceiveSize; iSendBufferSize = aSendSize; };
+
+    /** Set how long connect() and write() wait for the connection to be
+      made, or for room to send, before giving up
+      @param aTimeout Time to wait, in milliseconds
+    */
+    void setSocketTimeout(uint32_t aTimeout) { iSocketTimeout = aTimeout; };
+
+    /** Wait until there's data to read, or the server has closed the
+      connection
+      @param aMaxWait Longest time to wait, in milliseconds
+      @return true if there's something to read
+    */
+    bool waitUntilReadable(uint32_t aMaxWait) { return waitFor(POLLIN, aMaxWait); };
+
+    /** An HttpWaitForDataCallback, for an HttpClient using an
+      HttpSocketClient
+    */
+    static void waitForData(Client& aClient, uint32_t aMaxWait)
+      { static_cast<HttpSocketClient&>(aClient).waitUntilReadable(aMaxWait); };
+
+    /** Look up the IPv4 address of a server, as WiFi.hostByName() does.  It
+      can be given to an HttpDnsCache
+      @param aHostName Name of the server
+      @param aAddress Set to its address, if it's found
+      @return 1 if the address was found, else 0
+    */
+    static int hostByName(const char* aHostName, IPAddress& aAddress)
+    {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* addresses;
+        if (getaddrinfo(aHostName, NULL, &hints, &addresses) != 0)
+        {
+            return 0;
+        }
+        uint8_t* ip = (uint8_t*)&((struct sockaddr_in*)addresses->ai_addr)->sin_addr.s_addr;
+        aAddress = IPAddress(ip[0], ip[1], ip[2], ip[3]);
+        freeaddrinfo(addresses);
+        return 1;
+    };
+
+    virtual int connect(IPAddress aIP, uint16_t aPort)
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(aPort);
+        uint8_t* ip = (uint8_t*)&addr.sin_addr.s_addr;
+        for (int i = 0; i < 4; i++)
+        {
+            ip[i] = aIP[i];
+        }
+        return connectTo((struct sockaddr*)&addr, sizeof(addr));
+    };
+
+    virtual int connect(const char* aHost, uint16_t aPort)
+    {
+        char port[6];
+        snprintf(port, sizeof(port), "%u", aPort);
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* addresses;
+        if (getaddrinfo(aHost, port, &hints, &addresses) != 0)
+        {
+            return 0;
+        }
+        // Try each of the server's addresses in turn
+        int ret = 0;
+        for (struct addrinfo* a = addresses; a && (ret != 1); a = a->ai_next)
+        {
+            ret = connectTo(a->ai_addr, a->ai_addrlen);
+        }
+        freeaddrinfo(addresses);
+        return ret;
+    };
+
+    virtual size_t write(uint8_t aByte) { return write(&aByte, 1); };
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize)
+    {
+        // Like the network hardware's Clients, this doesn't return until
+        // all of it has been sent (or it fails)
+        size_t sent = 0;
+        while ((iSocket >= 0) && (sent < aSize))
+        {
+            ssize_t ret = send(iSocket, aBuffer+sent, aSize-sent, MSG_NOSIGNAL);
+            if (ret > 0)
+            {
+                sent += ret;
+            }
+            else if ((ret < 0) && (errno == EINTR))
+            {
+                // Try again
+            }
+            else if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            {
+                if (!waitFor(POLLOUT, iSocketTimeout))
+                {
+                    break;
+                }
+            }
+            else
+            {
+                stop();
+            }
+        }
+        return sent;
+    };
+
+    virtual int available()
+    {
+        int count = 0;
+        if ((iSocket < 0) || (ioctl(iSocket, FIONREAD, &count) < 0))
+        {
+            return 0;
+        }
+        return count;
+    };
+
+    virtual int read()
+    {
+        uint8_t b;
+        return (read(&b, 1) == 1) ? b : -1;
+    };
+
+    virtual int read(uint8_t* aBuffer, size_t aSize)
+    {
+        return receive(aBuffer, aSize, 0);
+    };
+
+    virtual int peek()
+    {
+        uint8_t b;
+        return (receive(&b, 1, MSG_PEEK) == 1) ? b : -1;
+    };
+
+    virtual void flush() {};
+
+    virtual void stop()
+    {
+        if (iSocket >= 0)
+        {
+            close(iSocket);
+            iSocket = -1;
+        }
+    };
+
+    virtual uint8_t connected()
+    {
+        if (iSocket < 0)
+        {
+            return 0;
+        }
+        // Until what the server sent before it closed the connection has
+        // been read, we count as still connected
+        if (available() > 0)
+        {
+            return 1;
+        }
+        if (!iPeerClosed)
+        {
+            uint8_t b;
+            receive(&b, 1, MSG_PEEK);
+        }
+        return !iPeerClosed;
+    };
+
+    virtual operator bool() { return iSocket >= 0; };
+
+protected:
+    /** Make a connection to aAddress, with the socket options we've been
+      given
+      @return 1 if successful, else 0
+    */
+    int connectTo(const struct sockaddr* aAddress, socklen_t aLength)
+    {
+        stop();
+        iPeerClosed = false;
+        iSocket = socket(aAddress->sa_family, SOCK_STREAM, 0);
+        if (iSocket < 0)
+        {
+            return 0;
+        }
+        fcntl(iSocket, F_SETFL, fcntl(iSocket, F_GETFL, 0) | O_NONBLOCK);
+        if (iNoDelay)
+        {
+            int on = 1;
+            setsockopt(iSocket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        if (iReceiveBufferSize)
+        {
+            setsockopt(iSocket, SOL_SOCKET, SO_RCVBUF, &iReceiveBufferSize, sizeof(iReceiveBufferSize));
+        }
+        if (iSendBufferSize)
+        {
+            setsockopt(iSocket, SOL_SOCKET, SO_SNDBUF, &iSendBufferSize, sizeof(iSendBufferSize));
+        }
+
+        if (::connect(iSocket, aAddress, aLength) < 0)
+        {
+            int error = 0;
+            socklen_t errorLength = sizeof(error);
+            if ((errno != EINPROGRESS) || !waitFor(POLLOUT, iSocketTimeout) ||
+                (getsockopt(iSocket, SOL_SOCKET, SO_ERROR, &error, &errorLength) < 0) ||
+                (error != 0))
+            {
+                stop();
+                return 0;
+            }
+        }
+        return 1;
+    };
+
+    /** Read from the socket without waiting
+      @return The number of bytes read, or -1 if there weren't any
+    */
+    int receive(uint8_t* aBuffer, size_t aSize, int aFlags)
+    {
+        if ((iSocket < 0) || (aSize == 0))
+        {
+            return -1;
+        }
+        ssize_t ret = recv(iSocket, aBuffer, aSize, aFlags);
+        if (ret > 0)
+        {
+            return ret;
+        }
+        if ((ret == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+        {
+            // The server has closed the connection, or it has failed
+            iPeerClosed = true;
+        }
+        return -1;
+    };
+
+    /** Wait for the socket to be ready for reading (aEvents of POLLIN) or
+      writing (POLLOUT)
+      @return true if it's ready
+    */
+    bool waitFor(short aEvents, uint32_t aMaxWait)
+    {
+        if (iSocket < 0)
+        {
+            return false;
+        }
+        struct pollfd p;
+        p.fd = iSocket;
+        p.events = aEvents;
+        p.revents = 0;
+        int ret = poll(&p, 1, (int)aMaxWait);
+        return (ret > 0) && (p.revents & (aEvents | POLLHUP | POLLERR));
+    };
+
+    static const uint32_t kDefaultSocketTimeout = 5000;
+
+    int iSocket;
+    // Whether we've seen the server close its end of the connection
+    bool iPeerClosed;
+    bool iNoDelay;
+    int iReceiveBufferSize;
+    int iSendBufferSize;
+    uint32_t iSocketTimeout;
+};
+
+#endif
@@ -4,67 +4,162 @@
 
 #include "b64.h"
 
-/* Simple test program
-#include <stdio.h>
-void main()
-{
-    char* in = "amcewen";
-    char out[22];
+static const char kB64Dictionary[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-    b64_encode(in, 15, out, 22);
-    out[21] = '\0';
+// Value of each character from '+' to 'z' in kB64Dictionary, or 0xFF for the
+// ones in that range which aren't base64
+static const char kB64First = '+';
+static const unsigned char kB64Values['z' - '+' + 1] = {
+    62, 0xFF, 0xFF, 0xFF, 63,                               // + , - . /
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61,                 // 0-9
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,               // : ; < = > ? @
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,               // A-M
+    13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,     // N-Z
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,                     // [ \ ] ^ _ `
+    26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38,     // a-m
+    39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51      // n-z
+};
 
-    printf(out);
+// Encode 3 bytes of input as 4 characters of output
+static inline void b64_encode_group(const unsigned char* aInput, unsigned char* aOutput)
+{
+    uint32_t group = ((uint32_t)aInput[0] << 16) | ((uint32_t)aInput[1] << 8) | aInput[2];
+    aOutput[0] = kB64Dictionary[(group >> 18) & 0x3F];
+    aOutput[1] = kB64Dictionary[(group >> 12) & 0x3F];
+    aOutput[2] = kB64Dictionary[(group >> 6) & 0x3F];
+    aOutput[3] = kB64Dictionary[group & 0x3F];
 }
-*/
 
 int b64_encode(const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen)
 {
-    // Work out if we've got enough space to encode the input
-    // Every 6 bits of input becomes a byte of output
-    if (aOutputLen < (aInputLen*8)/6)
+    if (aOutputLen < B64_ENCODED_LENGTH(aInputLen))
     {
-        // FIXME Should we return an error here, or just the length
-        return (aInputLen*8)/6;
+        return -1;
     }
+    b64_encode_state state;
+    b64_encode_init(&state);
+    int len = b64_encode_update(&state, aInput, aInputLen, aOutput, aOutputLen);
+    return len + b64_encode_final(&state, aOutput + len, aOutputLen - len);
+}
+
+void b64_encode_init(b64_encode_state* aState)
+{
+    aState->pendingLen = 0;
+}
 
-    // If we get here we've got enough space to do the encoding
+int b64_encode_update(b64_encode_state* aState, const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen)
+{
+    if (((aState->pendingLen + aInputLen) / 3) * 4 > aOutputLen)
+    {
+        return -1;
+    }
 
-    const char* b64_dictionary = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    if (aInputLen == 3)
+    unsigned char* output = aOutput;
+    if (aState->pendingLen > 0)
+    {
+        // Finish off the group left over from last time
+        while ((aState->pendingLen < 3) && (aInputLen > 0))
+        {
+            aState->pending[aState->pendingLen++] = *aInput++;
+            aInputLen--;
+        }
+        if (aState->pendingLen < 3)
+        {
+            return 0;
+        }
+        b64_encode_group(aState->pending, output);
+        output += 4;
+        aState->pendingLen = 0;
+    }
+    // Then do all the whole groups in one go
+    while (aInputLen >= 3)
     {
-        aOutput[0] = b64_dictionary[aInput[0] >> 2];
-        aOutput[1] = b64_dictionary[(aInput[0] & 0x3)<<4|(aInput[1]>>4)];
-        aOutput[2] = b64_dictionary[(aInput[1]&0x0F)<<2|(aInput[2]>>6)];
-        aOutput[3] = b64_dictionary[aInput[2]&0x3F];
+        b64_encode_group(aInput, output);
+        aInput += 3;
+        aInputLen -= 3;
+        output += 4;
     }
-    else if (aInputLen == 2)
+    // And keep what's left for next time
+    while (aInputLen-- > 0)
+    {
+        aState->pending[aState->pendingLen++] = *aInput++;
+    }
+    return output - aOutput;
+}
+
+int b64_encode_final(b64_encode_state* aState, unsigned char* aOutput, int aOutputLen)
+{
+    if (aState->pendingLen == 0)
     {
-        aOutput[0] = b64_dictionary[aInput[0] >> 2];
-        aOutput[1] = b64_dictionary[(aInput[0] & 0x3)<<4|(aInput[1]>>4)];
-        aOutput[2] = b64_dictionary[(aInput[1]&0x0F)<<2];
-        aOutput[3] = '=';
+        return 0;
     }
-    else if (aInputLen == 1)
+    if (aOutputLen < 4)
+    {
+        return -1;
+    }
+    // Encode the last group with zeros filling in the missing bytes, then
+    // replace the characters which only came from them with padding
+    uint8_t len = aState->pendingLen;
+    while (aState->pendingLen < 3)
+    {
+        aState->pending[aState->pendingLen++] = 0;
+    }
+    b64_encode_group(aState->pending, aOutput);
+    aOutput[3] = '=';
+    if (len == 1)
     {
-        aOutput[0] = b64_dictionary[aInput[0] >> 2];
-        aOutput[1] = b64_dictionary[(aInput[0] & 0x3)<<4];
         aOutput[2] = '=';
-        aOutput[3] = '=';
     }
-    else
+    aState->pendingLen = 0;
+    return 4;
+}
+
+int b64_decode(const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen)
+{
+    // We don't need the padding to work out how long the output is
+    for (uint8_t i = 0; (i < 2) && (aInputLen > 0) && (aInput[aInputLen-1] == '='); i++)
+    {
+        aInputLen--;
+    }
+    if (aInputLen % 4 == 1)
     {
-        // Break the input into 3-byte chunks and process each of them
-        int i;
-        for (i = 0; i < aInputLen/3; i++)
+        // That's not a whole byte
+        return -1;
+    }
+    int outputLen = (aInputLen / 4) * 3 + ((aInputLen % 4) ? (aInputLen % 4) - 1 : 0);
+    if (outputLen > aOutputLen)
+    {
+        return -1;
+    }
+
+    // Every 4 characters are 24 bits, or 3 bytes, of output
+    unsigned char* output = aOutput;
+    uint32_t group = 0;
+    for (int i = 0; i < aInputLen; i++)
+    {
+        unsigned char c = aInput[i] - kB64First;
+        if ((c >= sizeof(kB64Values)) || (kB64Values[c] == 0xFF))
         {
-            b64_encode(&aInput[i*3], 3, &aOutput[i*4], 4);
+            return -1;
         }
-        if (aInputLen % 3 > 0)
+        group = (group << 6) | kB64Values[c];
+        if ((i & 3) == 3)
         {
-            // It doesn't fit neatly into a 3-byte chunk, so process what's left
-            b64_encode(&aInput[i*3], aInputLen % 3, &aOutput[i*4], aOutputLen - (i*4));
+            output[0] = group >> 16;
+            output[1] = group >> 8;
+            output[2] = group;
+            output += 3;
         }
     }
+    // Then whatever's left over from an incomplete group
+    if (aInputLen % 4 == 2)
+    {
+        output[0] = group >> 4;
+    }
+    else if (aInputLen % 4 == 3)
+    {
+        output[0] = group >> 10;
+        output[1] = group >> 2;
+    }
+    return outputLen;
 }
-
@@ -1,6 +1,47 @@
 #ifndef b64_h
 #define b64_h
 
+#include <stdint.h>
+
+// Number of characters needed to base64 encode aLen bytes, not including
+// any '\0' terminator
+#define B64_ENCODED_LENGTH(aLen) ((((aLen) + 2) / 3) * 4)
+// Most bytes aLen characters of base64 can decode to
+#define B64_DECODED_LENGTH(aLen) ((((aLen) + 3) / 4) * 3)
+
+/** Base64 encode a buffer.  The output isn't '\0' terminated
+  @return Number of characters written to aOutput, or -1 if aOutputLen isn't
+          big enough (see B64_ENCODED_LENGTH)
+*/
 int b64_encode(const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen);
 
+/** Decode a buffer of base64.  The '=' padding at the end is optional
+  @return Number of bytes written to aOutput, or -1 if the input isn't valid
+          base64 or aOutputLen isn't big enough (see B64_DECODED_LENGTH)
+*/
+int b64_decode(const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen);
+
+// For encoding data which arrives in pieces, such as the parts of a
+// username and password, without copying it all into one buffer first
+typedef struct
+{
+    // Input which didn't make up a whole 3 byte group last time
+    unsigned char pending[3];
+    uint8_t pendingLen;
+} b64_encode_state;
+
+void b64_encode_init(b64_encode_state* aState);
+
+/** Base64 encode the next piece of the data
+  @return Number of characters written to aOutput, which needs room for
+          B64_ENCODED_LENGTH(aInputLen), or -1 if it hasn't got room
+*/
+int b64_encode_update(b64_encode_state* aState, const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen);
+
+/** Finish off the encoding, padding any remaining input
+  @return Number of characters written to aOutput (0 or 4), or -1 if
+          aOutputLen isn't big enough
+*/
+int b64_encode_final(b64_encode_state* aState, unsigned char* aOutput, int aOutputLen);
+
 #endif
@@ -0,0 +1,357 @@
+// Times HttpClient on a host, playing canned responses back through an
+// HttpMockClient so that no network or server is involved
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+//
+// For each of the paths through a response it reports how many requests a
+// second can be made, the CPU time taken per byte of the response, and the
+// calls made to the Client for each request.  Run it before and after a
+// change to HttpClient.cpp to see what difference the change makes:
+//   make run
+// or give the number of requests to time each path with:
+//   ./build/benchmark 50000
+// It can also time how long the status line takes to be read when the
+// server is slow to answer, waiting for it with a fixed 1 second delay (as
+// HttpClient used to) and with the default backoff:
+//   make latency
+// or give the number of requests to take the median of with:
+//   ./build/benchmark latency 9
+// After the requests, "make run" also times the base64 code used for
+// sendBasicAuth(), against the recursive encoder it replaced
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <Arduino.h>
+#include "HttpClient.h"
+#include "HttpMockClient.h"
+#include "b64.h"
+
+// The old encoder, in old_b64.cpp
+int old_b64_encode(const unsigned char* aInput, int aInputLen, unsigned char* aOutput, int aOutputLen);
+
+// Headers like a typical web server sends, so reading the headers isn't
+// made to look cheaper than it is
+#define BENCHMARK_HEADERS \
+    "Date: Sun, 18 Oct 2026 12:00:00 GMT\r\n" \
+    "Server: Apache/2.4.41 (Ubuntu)\r\n" \
+    "Last-Modified: Mon, 12 Oct 2026 08:30:00 GMT\r\n" \
+    "ETag: \"3f80f-1b6-3e1cb03b\"\r\n" \
+    "Accept-Ranges: bytes\r\n" \
+    "Cache-Control: max-age=3600\r\n" \
+    "Vary: Accept-Encoding\r\n" \
+    "Content-Type: text/plain; charset=UTF-8\r\n"
+
+static const size_t kBodyLength = 16384;
+static const size_t kChunkLength = 1024;
+static const size_t kReadSize = 256;
+
+// What the benchmark does with each response
+enum tPath
+{
+    // Just read the status code
+    eStatus,
+    // Read the status code and skip the headers
+    eHeaders,
+    // Read all of the body as well
+    eBody
+};
+
+struct tScenario
+{
+    const char* iName;
+    tPath iPath;
+    bool iChunked;
+    // Most bytes which arrive at once, or 0 for all of them
+    size_t iFragmentSize;
+};
+
+static const tScenario kScenarios[] =
+{
+    { "status",            eStatus,  false, 0 },
+    { "headers",           eHeaders, false, 0 },
+    { "body",              eBody,    false, 0 },
+    { "body-chunked",      eBody,    true,  0 },
+    { "body-fragmented",   eBody,    false, 536 },
+    { "headers-bytewise",  eHeaders, false, 1 },
+};
+
+/** CPU time used by the process so far, in nanoseconds */
+static unsigned long long cpuTime()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (unsigned long long)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+/** Time since some fixed point, in nanoseconds */
+static unsigned long long wallTime()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+/** Put together the response for aScenario
+  @return The response, which the caller should free()
+*/
+static char* buildResponse(const tScenario& aScenario, size_t& aLength)
+{
+    size_t chunks = kBodyLength / kChunkLength;
+    char* response = (char*)malloc(1024 + kBodyLength + chunks*16);
+    size_t length = 0;
+    if (aScenario.iChunked)
+    {
+        length += sprintf(response, "HTTP/1.1 200 OK\r\n" BENCHMARK_HEADERS
+                          "Transfer-Encoding: chunked\r\n\r\n");
+    }
+    else
+    {
+        length += sprintf(response, "HTTP/1.1 200 OK\r\n" BENCHMARK_HEADERS
+                          "Content-Length: %u\r\n\r\n", (unsigned)kBodyLength);
+    }
+    for (size_t i = 0; i < chunks; i++)
+    {
+        if (aScenario.iChunked)
+        {
+            length += sprintf(response+length, "%x\r\n", (unsigned)kChunkLength);
+        }
+        for (size_t j = 0; j < kChunkLength; j++)
+        {
+            response[length++] = 'a' + (j % 26);
+        }
+        if (aScenario.iChunked)
+        {
+            length += sprintf(response+length, "\r\n");
+        }
+    }
+    if (aScenario.iChunked)
+    {
+        length += sprintf(response+length, "0\r\n\r\n");
+    }
+    aLength = length;
+    return response;
+}
+
+/** Make one request, and deal with the response as aScenario says
+  @return true if it went as expected
+*/
+static bool makeRequest(HttpClient& aHttp, const tScenario& aScenario)
+{
+    if (aHttp.get("benchmark.example.com", "/data.txt") != HTTP_SUCCESS)
+    {
+        return false;
+    }
+    bool ok = (aHttp.responseStatusCode() == 200);
+    if (ok && (aScenario.iPath != eStatus))
+    {
+        ok = (aHttp.skipResponseHeaders() == HTTP_SUCCESS);
+    }
+    if (ok && (aScenario.iPath == eBody))
+    {
+        uint8_t buffer[kReadSize];
+        size_t total = 0;
+        int len;
+        while ((len = aHttp.read(buffer, sizeof(buffer))) > 0)
+        {
+            total += len;
+        }
+        ok = aHttp.endOfBodyReached() && (total == kBodyLength);
+    }
+    aHttp.stop();
+    return ok;
+}
+
+static bool runScenario(const tScenario& aScenario, unsigned long aRequests)
+{
+    size_t responseLength;
+    char* response = buildResponse(aScenario, responseLength);
+    HttpMockClient client;
+    client.setResponse(response, responseLength);
+    client.setFragments(aScenario.iFragmentSize);
+    HttpClient http(client);
+
+    // Once through first, so that the first request's costs aren't counted
+    bool ok = makeRequest(http, aScenario);
+    client.resetCounts();
+
+    unsigned long long bytes = 0;
+    unsigned long long startWall = wallTime();
+    unsigned long long startCpu = cpuTime();
+    for (unsigned long i = 0; ok && (i < aRequests); i++)
+    {
+        ok = makeRequest(http, aScenario);
+        bytes += client.receivedLength();
+    }
+    unsigned long long cpu = cpuTime() - startCpu;
+    unsigned long long wall = wallTime() - startWall;
+    free(response);
+
+    if (!ok)
+    {
+        printf("%-18s failed\n", aScenario.iName);
+        return false;
+    }
+    printf("%-18s %12.0f %10.2f %10.1f %10.1f %10.1f %10.0f\n", aScenario.iName,
+           aRequests * 1e9 / wall,
+           (double)cpu / bytes,
+           (double)client.readCalls() / aRequests,
+           (double)client.writeCalls() / aRequests,
+           (double)client.availableCalls() / aRequests,
+           (double)bytes / aRequests);
+    return true;
+}
+
+// Size of the buffer the base64 code is timed on, and how many times it's
+// encoded or decoded
+static const int kB64Length = 1024*1024;
+static const int kB64Passes = 20;
+
+/** Print how fast aTime nanoseconds for kB64Passes of kB64Length bytes is */
+static void printB64Rate(const char* aName, unsigned long long aTime)
+{
+    printf("%-18s %10.1f\n", aName, (double)kB64Length * kB64Passes * 1e3 / aTime);
+}
+
+static bool runB64()
+{
+    unsigned char* input = new unsigned char[kB64Length];
+    int encodedSize = B64_ENCODED_LENGTH(kB64Length);
+    unsigned char* encoded = new unsigned char[encodedSize];
+    unsigned char* oldEncoded = new unsigned char[encodedSize];
+    unsigned char* decoded = new unsigned char[B64_DECODED_LENGTH(encodedSize)];
+    srand(1);
+    for (int i = 0; i < kB64Length; i++)
+    {
+        input[i] = rand();
+    }
+
+    printf("\n%-18s %10s\n", "base64", "MB/s");
+    unsigned long long start = cpuTime();
+    int encodedLength = 0;
+    for (int i = 0; i < kB64Passes; i++)
+    {
+        encodedLength = b64_encode(input, kB64Length, encoded, encodedSize);
+    }
+    printB64Rate("encode", cpuTime() - start);
+
+    start = cpuTime();
+    for (int i = 0; i < kB64Passes; i++)
+    {
+        old_b64_encode(input, kB64Length, oldEncoded, encodedSize);
+    }
+    printB64Rate("encode (old)", cpuTime() - start);
+
+    start = cpuTime();
+    int decodedLength = 0;
+    for (int i = 0; i < kB64Passes; i++)
+    {
+        decodedLength = b64_decode(encoded, encodedLength, decoded, B64_DECODED_LENGTH(encodedSize));
+    }
+    printB64Rate("decode", cpuTime() - start);
+
+    // Check that they all agree
+    bool ok = (encodedLength == encodedSize) && (memcmp(encoded, oldEncoded, encodedSize) == 0) &&
+              (decodedLength == kB64Length) && (memcmp(decoded, input, kB64Length) == 0);
+    if (!ok)
+    {
+        printf("base64 results don't match\n");
+    }
+    delete[] input;
+    delete[] encoded;
+    delete[] oldEncoded;
+    delete[] decoded;
+    return ok;
+}
+
+// How long the "server" takes to start its response in the latency
+// benchmark, in milliseconds
+static const uint32_t kFirstByteDelays[] = { 5, 50, 250 };
+
+/** Median time taken to get the status code, when the response starts to
+  arrive aFirstByteDelay milliseconds after connecting
+  @param aFixedDelay true to wait in steps of 1 second, false to use the
+                     default backoff
+  @return The median time, in milliseconds
+*/
+static double medianTimeToStatus(uint32_t aFirstByteDelay, bool aFixedDelay, unsigned aSamples)
+{
+    static const char kResponse[] = "HTTP/1.1 200 OK\r\n" BENCHMARK_HEADERS "Content-Length: 0\r\n\r\n";
+    HttpMockClient client;
+    client.setResponse(kResponse);
+    client.setFragments(0, aFirstByteDelay);
+    HttpClient http(client);
+    if (aFixedDelay)
+    {
+        http.setWaitForDataDelay(1000, 1000);
+    }
+    unsigned long* times = new unsigned long[aSamples];
+    for (unsigned i = 0; i < aSamples; i++)
+    {
+        unsigned long start = micros();
+        if ((http.get("benchmark.example.com", "/data.txt") != HTTP_SUCCESS) ||
+            (http.responseStatusCode() != 200))
+        {
+            delete[] times;
+            return -1;
+        }
+        times[i] = micros() - start;
+        http.stop();
+    }
+    std::sort(times, times + aSamples);
+    double median = (aSamples % 2) ? times[aSamples/2] : (times[aSamples/2 - 1] + times[aSamples/2]) / 2.0;
+    delete[] times;
+    return median / 1000;
+}
+
+static bool runLatency(unsigned aSamples)
+{
+    printf("Median time to status of %u requests, in milliseconds\n\n", aSamples);
+    printf("%-18s %12s %12s\n", "first byte after", "fixed 1 s", "backoff");
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(kFirstByteDelays)/sizeof(kFirstByteDelays[0]); i++)
+    {
+        double fixed = medianTimeToStatus(kFirstByteDelays[i], true, aSamples);
+        double backoff = medianTimeToStatus(kFirstByteDelays[i], false, aSamples);
+        ok = ok && (fixed >= 0) && (backoff >= 0);
+        printf("%15lu ms %12.1f %12.1f\n", (unsigned long)kFirstByteDelays[i], fixed, backoff);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    if ((argc > 1) && (strcmp(argv[1], "latency") == 0))
+    {
+        unsigned samples = (argc > 2) ? strtoul(argv[2], NULL, 10) : 5;
+        if (samples == 0)
+        {
+            fprintf(stderr, "Usage: %s latency [requests]\n", argv[0]);
+            return 1;
+        }
+        return runLatency(samples) ? 0 : 1;
+    }
+
+    unsigned long requests = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    if (requests == 0)
+    {
+        fprintf(stderr, "Usage: %s [requests]\n       %s latency [requests]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    printf("%lu requests for each path, reading the body %u bytes at a time\n\n",
+           requests, (unsigned)kReadSize);
+    printf("%-18s %12s %10s %10s %10s %10s %10s\n", "path", "requests/s",
+           "ns/byte", "reads", "writes", "available", "bytes");
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(kScenarios)/sizeof(kScenarios[0]); i++)
+    {
+        ok = runScenario(kScenarios[i], requests) && ok;
+    }
+    printf("\nreads, writes and available are calls to the Client per request, and\n"
+           "bytes is how much of the response was read from it\n");
+    ok = runB64() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+// Just enough of the Arduino core to build HttpClient on a host, for the
+// benchmark in extras/host
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+static unsigned long long now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec*1000000ULL + t.tv_nsec/1000;
+}
+
+// Times count from the first call, as they do from startup on a board
+static unsigned long long gStart = now();
+
+unsigned long millis()
+{
+    return (now() - gStart) / 1000;
+}
+
+unsigned long micros()
+{
+    return now() - gStart;
+}
+
+void delay(unsigned long aMilliseconds)
+{
+    usleep(aMilliseconds * 1000);
+}
+
+void yield()
+{
+}
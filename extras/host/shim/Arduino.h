@@ -0,0 +1,54 @@
+// Just enough of the Arduino core to build HttpClient on a host, for the
+// benchmark in extras/host
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define DEC 10
+#define HEX 16
+
+// Everything is in RAM on a host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+/** Milliseconds since the program started */
+unsigned long millis();
+/** Microseconds since the program started */
+unsigned long micros();
+void delay(unsigned long aMilliseconds);
+void yield();
+
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+
+/** Serial writes to stdout, for the LOGGING output */
+class HardwareSerial : public Stream
+{
+public:
+    virtual size_t write(uint8_t aByte) { return (fputc(aByte, stdout) == EOF) ? 0 : 1; };
+    using Print::write;
+    virtual int available() { return 0; };
+    virtual int read() { return -1; };
+    virtual int peek() { return -1; };
+    virtual void flush() { fflush(stdout); };
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,32 @@
+// Just enough of the Arduino core to build HttpClient on a host, for the
+// benchmark in extras/host
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef Client_h
+#define Client_h
+
+#include "Arduino.h"
+
+class Client : public Stream
+{
+public:
+    virtual int connect(IPAddress aIP, uint16_t aPort) =0;
+    virtual int connect(const char* aHost, uint16_t aPort) =0;
+    virtual size_t write(uint8_t aByte) =0;
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize) =0;
+    using Print::write;
+    virtual int available() =0;
+    virtual int read() =0;
+    virtual int read(uint8_t* aBuffer, size_t aSize) =0;
+    virtual int peek() =0;
+    virtual void flush() =0;
+    virtual void stop() =0;
+    virtual uint8_t connected() =0;
+    virtual operator bool() =0;
+
+protected:
+    uint8_t* rawIPAddress(IPAddress& aAddress) { return aAddress.iAddress; };
+};
+
+#endif
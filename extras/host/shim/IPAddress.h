@@ -0,0 +1,39 @@
+// Just enough of the Arduino core to build HttpClient on a host, for the
+// benchmark in extras/host
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <stdint.h>
+#include <string.h>
+#include "Print.h"
+
+class IPAddress
+{
+public:
+    IPAddress() { memset(iAddress, 0, sizeof(iAddress)); };
+    IPAddress(uint8_t aFirst, uint8_t aSecond, uint8_t aThird, uint8_t aFourth)
+      { iAddress[0] = aFirst; iAddress[1] = aSecond; iAddress[2] = aThird; iAddress[3] = aFourth; };
+    IPAddress(uint32_t aAddress) { memcpy(iAddress, &aAddress, sizeof(iAddress)); };
+
+    operator uint32_t() const { uint32_t ret; memcpy(&ret, iAddress, sizeof(ret)); return ret; };
+    bool operator==(const IPAddress& aOther) const { return memcmp(iAddress, aOther.iAddress, sizeof(iAddress)) == 0; };
+    bool operator!=(const IPAddress& aOther) const { return !(*this == aOther); };
+    uint8_t operator[](int aIndex) const { return iAddress[aIndex]; };
+    uint8_t& operator[](int aIndex) { return iAddress[aIndex]; };
+
+protected:
+    friend class Client;
+    uint8_t iAddress[4];
+};
+
+inline size_t Print::print(const IPAddress& aAddress)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", aAddress[0], aAddress[1], aAddress[2], aAddress[3]);
+    return write(buffer);
+}
+
+#endif
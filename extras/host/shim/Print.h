@@ -0,0 +1,61 @@
+// Just enough of the Arduino core to build HttpClient on a host, for the
+// benchmark in extras/host
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef Print_h
+#define Print_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+class IPAddress;
+
+class Print
+{
+public:
+    virtual ~Print() {};
+
+    virtual size_t write(uint8_t aByte) =0;
+    virtual size_t write(const uint8_t* aBuffer, size_t aSize)
+    {
+        size_t ret = 0;
+        while (aSize--)
+        {
+            ret += write(*aBuffer++);
+        }
+        return ret;
+    };
+    size_t write(const char* aString)
+      { return aString ? write((const uint8_t*)aString, strlen(aString)) : 0; };
+    size_t write(const char* aBuffer, size_t aSize) { return write((const uint8_t*)aBuffer, aSize); };
+    virtual void flush() {};
+
+    size_t print(const char* aString) { return write(aString); };
+    size_t print(char aChar) { return write((uint8_t)aChar); };
+    size_t print(unsigned char aNumber, int aBase =DEC) { return print((unsigned long)aNumber, aBase); };
+    size_t print(int aNumber, int aBase =DEC) { return print((long)aNumber, aBase); };
+    size_t print(unsigned int aNumber, int aBase =DEC) { return print((unsigned long)aNumber, aBase); };
+    size_t print(long aNumber, int aBase =DEC)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), (aBase == HEX) ? "%lx" : "%ld", aNumber);
+        return write(buffer);
+    };
+    size_t print(unsigned long aNumber, int aBase =DEC)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), (aBase == HEX) ? "%lx" : "%lu", aNumber);
+        return write(buffer);
+    };
+    size_t print(const IPAddress& aAddress);
+
+    size_t println() { return write("\r\n"); };
+    template<typename T> size_t println(T aValue) { size_t ret = print(aValue); return ret + println(); };
+    template<typename T> size_t println(T aValue, int aBase)
+      { size_t ret = print(aValue, aBase); return ret + println(); };
+};
+
+#endif
@@ -0,0 +1,34 @@
+// Just enough of the Arduino core to build HttpClient on a host, for the
+// benchmark in extras/host
+// (c) Copyright MCQN Ltd
+// Released under Apache License, version 2.0
+
+#ifndef Stream_h
+#define Stream_h
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+    virtual int available() =0;
+    virtual int read() =0;
+    virtual int peek() =0;
+
+    /** Read up to aLength bytes, stopping early if no more are available.
+      Unlike the real Stream this doesn't wait for them
+    */
+    size_t readBytes(char* aBuffer, size_t aLength)
+    {
+        size_t count = 0;
+        int c;
+        while ((count < aLength) && ((c = read()) >= 0))
+        {
+            aBuffer[count++] = c;
+        }
+        return count;
+    };
+    size_t readBytes(uint8_t* aBuffer, size_t aLength) { return readBytes((char*)aBuffer, aLength); };
+};
+
+#endif